@@ -0,0 +1,191 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  an Aho-Corasick automaton to look for many byte strings in one
+ *  pass.  the trie of patterns is turned into a full DFA, 256 next
+ *  states per state, so a scan is one table lookup per byte however
+ *  many patterns there are.  each state also points at the longest
+ *  proper suffix of it that ends a pattern, to report patterns that
+ *  end inside a longer one.  patterns may be added after a scan, the
+ *  DFA is rebuilt the next time it's needed.
+ */
+#include "ip.h"
+#include "dat.h"
+
+struct Ac
+{
+	int	npat;
+	uint8_t	**pat;
+	int	*len;
+
+	int	nstate;
+	int	astate;
+	int	*next;	/* 256 per state */
+	int	*out;	/* pattern ending at the state, or -1 */
+	int	*dict;	/* next state down the suffix chain with an out, or 0 */
+	int	built;
+};
+
+Ac*
+mkac(void)
+{
+	Ac *a;
+
+	a = calloc(1, sizeof *a);
+	if(a == NULL)
+		sysfatal("mkac: %r");
+	return a;
+}
+
+/*
+ *  add a pattern, return its number.  the same bytes
+ *  added twice get the same number.
+ */
+int
+acadd(Ac *a, uint8_t *p, int n)
+{
+	int i;
+
+	if(n <= 0)
+		sysfatal("empty pattern");
+	for(i = 0; i < a->npat; i++)
+		if(a->len[i] == n && memcmp(a->pat[i], p, n) == 0)
+			return i;
+
+	a->pat = realloc(a->pat, (a->npat+1)*sizeof(uint8_t*));
+	a->len = realloc(a->len, (a->npat+1)*sizeof(int));
+	if(a->pat == NULL || a->len == NULL)
+		sysfatal("acadd: %r");
+	a->pat[i] = malloc(n);
+	if(a->pat[i] == NULL)
+		sysfatal("acadd: %r");
+	memmove(a->pat[i], p, n);
+	a->len[i] = n;
+	a->npat++;
+	a->built = 0;
+	return i;
+}
+
+int
+acnpat(Ac *a)
+{
+	return a->npat;
+}
+
+static int
+newstate(Ac *a)
+{
+	int s;
+
+	if(a->nstate == a->astate){
+		a->astate = a->astate ? 2*a->astate : 64;
+		a->next = realloc(a->next, a->astate*256*sizeof(int));
+		a->out = realloc(a->out, a->astate*sizeof(int));
+		a->dict = realloc(a->dict, a->astate*sizeof(int));
+		if(a->next == NULL || a->out == NULL || a->dict == NULL)
+			sysfatal("acbuild: %r");
+	}
+	s = a->nstate++;
+	memset(a->next + s*256, -1, 256*sizeof(int));
+	a->out[s] = -1;
+	a->dict[s] = 0;
+	return s;
+}
+
+static void
+acbuild(Ac *a)
+{
+	int *q, *fail, *next;
+	int i, j, c, s, t, k, qh, qt;
+
+	/* the trie, -1 for no edge */
+	a->nstate = 0;
+	newstate(a);
+	for(i = 0; i < a->npat; i++){
+		s = 0;
+		for(j = 0; j < a->len[i]; j++){
+			c = a->pat[i][j];
+			if(a->next[s*256 + c] < 0){
+				t = newstate(a);
+				a->next[s*256 + c] = t;
+			}
+			s = a->next[s*256 + c];
+		}
+		a->out[s] = i;
+	}
+
+	/*
+	 *  breadth first, fill in the missing edges from each
+	 *  state's failure state, which is always shallower
+	 */
+	q = malloc(a->nstate*sizeof(int));
+	fail = malloc(a->nstate*sizeof(int));
+	if(q == NULL || fail == NULL)
+		sysfatal("acbuild: %r");
+	next = a->next;
+	qh = qt = 0;
+	for(c = 0; c < 256; c++){
+		t = next[c];
+		if(t < 0)
+			next[c] = 0;
+		else {
+			fail[t] = 0;
+			q[qt++] = t;
+		}
+	}
+	while(qh < qt){
+		s = q[qh++];
+		for(c = 0; c < 256; c++){
+			t = next[s*256 + c];
+			k = next[fail[s]*256 + c];
+			if(t < 0){
+				next[s*256 + c] = k;
+				continue;
+			}
+			fail[t] = k;
+			a->dict[t] = a->out[k] >= 0 ? k : a->dict[k];
+			q[qt++] = t;
+		}
+	}
+	free(q);
+	free(fail);
+	a->built = 1;
+}
+
+/*
+ *  set bit i of hit for each pattern i found in ps..pe.
+ *  hit must hold acnpat() bits and be zeroed by the caller.
+ */
+void
+acscan(Ac *a, uint8_t *ps, uint8_t *pe, uint32_t *hit)
+{
+	int *next, *out, *dict;
+	int s, t, left;
+
+	if(a->npat == 0)
+		return;
+	if(!a->built)
+		acbuild(a);
+	next = a->next;
+	out = a->out;
+	dict = a->dict;
+	left = a->npat;
+	s = 0;
+	for(; ps < pe; ps++){
+		s = next[s*256 + *ps];
+		for(t = out[s] >= 0 ? s : dict[s]; t != 0; t = dict[t]){
+			if(hit[out[t]>>5] & (1u<<(out[t]&31)))
+				continue;
+			hit[out[t]>>5] |= 1u<<(out[t]&31);
+			if(--left == 0)
+				return;
+		}
+	}
+}
@@ -78,11 +78,11 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Omajor:
-		return NetS(h->major) == f->ulv;
+		return fmatch(f, NetS(h->major));
 	case Ominor:
-		return h->minor == f->ulv;
+		return fmatch(f, h->minor);
 	case Ocmd:
-		return h->cmd == f->ulv;
+		return fmatch(f, h->cmd);
 	}
 	return 0;
 }
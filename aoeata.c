@@ -84,21 +84,21 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Oaflag:
-		return h->aflag == f->ulv;
+		return fmatch(f, h->aflag);
 	case Ocmd:
-		return h->cmd == f->ulv;
+		return fmatch(f, h->cmd);
 	case Ofeat:
-		return h->feat == f->ulv;
+		return fmatch(f, h->feat);
 	case Osectors:
-		return h->sectors == f->ulv;
+		return fmatch(f, h->sectors);
 	case Olba:
 		return llba(h->lba) == f->vlv;
 
 	/* this is wrong, but we don't have access to the direction here */
 	case Ostat:
-		return h->cmd == f->ulv;
+		return fmatch(f, h->cmd);
 	case Oerr:
-		return h->feat == f->ulv;
+		return fmatch(f, h->feat);
 	}
 	return 0;
 }
@@ -57,7 +57,7 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Ocmd:
-		return (h->ccmd & 0xf) == f->ulv;
+		return fmatch(f, h->ccmd & 0xf);
 	}
 	return 0;
 }
@@ -73,11 +73,11 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Ocmd:
-		return h->cmd == f->ulv;
+		return fmatch(f, h->cmd);
 	case Oerr:
-		return h->err == f->ulv;
+		return fmatch(f, h->err);
 	case Ocnt:
-		return h->cnt == f->ulv;
+		return fmatch(f, h->cnt);
 	}
 	return 0;
 }
@@ -56,7 +56,7 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Ocmd:
-		return h->cmd == f->ulv;
+		return fmatch(f, h->cmd);
 	case Oea:
 		for(i = 0; i < 6; i++)
 			buf[i] = f->ulv >> ((5 - i)*8);
@@ -57,9 +57,9 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Ocmd:
-		return h->cmd == f->ulv;
+		return fmatch(f, h->cmd);
 	case Onea:
-		return h->nea == f->ulv;
+		return fmatch(f, h->nea);
 	case Oea:
 		if(m->pe - m->ps < 6*h->nea)
 			return 0;
@@ -76,12 +76,12 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Ospa:
-		return h->pln == 4 && NetL(h->spa) == f->ulv;
+		return h->pln == 4 && fmatch(f, NetL(h->spa));
 	case Otpa:
-		return h->pln == 4 && NetL(h->tpa) == f->ulv;
+		return h->pln == 4 && fmatch(f, NetL(h->tpa));
 	case Ostpa:
-		return h->pln == 4 && (NetL(h->tpa) == f->ulv ||
-			NetL(h->spa) == f->ulv);
+		return h->pln == 4 && (fmatch(f, NetL(h->tpa)) ||
+			fmatch(f, NetL(h->spa)));
 	case Osha:
 		return memcmp(h->sha, f->a, h->hln) == 0;
 	case Otha:
@@ -0,0 +1,333 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  apply a filter to a batch of packets at once.  filter nodes that
+ *  a module can lower to a fixed-offset compare (see Proto.lower)
+ *  gather the field from every packet and compare them with one
+ *  vector instruction; anything else runs the module's filter one
+ *  packet at a time.  the result is a bit mask of matching packets.
+ */
+#include "ip.h"
+#include "dat.h"
+#include "protos.h"
+#include "y.tab.h"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+/*
+ *  the state of a batch walk, one Msg per packet
+ */
+typedef struct Vmsg Vmsg;
+struct Vmsg
+{
+	int	off[Nbatch];	/* start of current header in each packet */
+	int	end[Nbatch];	/* and of what's left, as a test may shorten it */
+	int	needroot;
+	Proto	*pr;
+};
+
+/*
+ *  a memo (see cse.c) for a batch: which packets have been
+ *  tested, which passed, and where their next headers start
+ */
+typedef struct Vmemo Vmemo;
+struct Vmemo
+{
+	uint32_t	gen;
+	uint32_t	done;
+	uint32_t	ok;
+	int	off[Nbatch];
+	int	end[Nbatch];
+};
+
+static Vmemo	*vmemo;
+static int	nvmemo;
+static uint32_t	vmemogen;
+
+/*
+ *  compare Nbatch values against v, return the bit mask of equal ones
+ */
+typedef uint32_t Eqfn(uint32_t*, uint32_t);
+
+#ifdef __x86_64__
+static uint32_t
+eqsse(uint32_t *x, uint32_t v)
+{
+	__m128i vv, c;
+	uint32_t mask;
+	int i;
+
+	vv = _mm_set1_epi32(v);
+	mask = 0;
+	for(i = 0; i < Nbatch; i += 4){
+		c = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i*)(x+i)), vv);
+		mask |= _mm_movemask_ps(_mm_castsi128_ps(c)) << i;
+	}
+	return mask;
+}
+
+__attribute__((target("avx2")))
+static uint32_t
+eqavx2(uint32_t *x, uint32_t v)
+{
+	__m256i vv, c;
+	uint32_t mask;
+	int i;
+
+	vv = _mm256_set1_epi32(v);
+	mask = 0;
+	for(i = 0; i < Nbatch; i += 8){
+		c = _mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i*)(x+i)), vv);
+		mask |= _mm256_movemask_ps(_mm256_castsi256_ps(c)) << i;
+	}
+	return mask;
+}
+
+static Eqfn*
+pickeq(void)
+{
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		return eqavx2;
+	return eqsse;
+}
+#else
+static uint32_t
+eqscalar(uint32_t *x, uint32_t v)
+{
+	uint32_t mask;
+	int i;
+
+	mask = 0;
+	for(i = 0; i < Nbatch; i++)
+		if(x[i] == v)
+			mask |= 1<<i;
+	return mask;
+}
+
+static Eqfn*
+pickeq(void)
+{
+	return eqscalar;
+}
+#endif
+
+static Eqfn *eq;
+
+static uint32_t
+vload(uint8_t *p, int width)
+{
+	switch(width){
+	case 1:
+		return *p;
+	case 2:
+		return NetS(p);
+	}
+	return NetL(p);
+}
+
+/*
+ *  a lowered filter node: gather, compare, skip the header
+ */
+static uint32_t
+vword(Vop *v, Vmsg *vm, Batch *b, uint32_t live)
+{
+	uint32_t x0[Nbatch], x1[Nbatch];
+	uint32_t ok, match;
+	uint8_t *h;
+	int i;
+
+	ok = 0;
+	for(i = 0; i < Nbatch; i++){
+		x0[i] = x1[i] = 0;
+		if((live & (1<<i)) == 0)
+			continue;
+		h = b->pkt[i].ps + vm->off[i];
+		if(vm->end[i] - vm->off[i] < v->minlen)
+			continue;
+		ok |= 1<<i;
+		if(v->noff > 0)
+			x0[i] = vload(h + v->off[0], v->width) & v->mask;
+		if(v->noff > 1)
+			x1[i] = vload(h + v->off[1], v->width) & v->mask;
+		vm->off[i] += v->hlen + (((h[v->hoff] & v->hmask)<<2)>>v->hshift);
+	}
+	if(v->noff == 0)
+		return ok;
+	match = (*eq)(x0, v->val);
+	if(v->noff > 1)
+		match |= (*eq)(x1, v->val);
+	return ok & match;
+}
+
+/*
+ *  a filter node the module couldn't lower, one packet at a time
+ */
+static uint32_t
+sword(Filter *f, Vmsg *vm, Batch *b, uint32_t live)
+{
+	Msg m;
+	uint32_t match;
+	int i;
+
+	match = 0;
+	for(i = 0; i < b->n; i++){
+		if((live & (1<<i)) == 0)
+			continue;
+		m.needroot = 0;
+		m.ps = b->pkt[i].ps + vm->off[i];
+		m.pe = b->pkt[i].ps + vm->end[i];
+		m.pr = vm->pr;
+		if(wordtest(f, &m))
+			match |= 1<<i;
+		vm->off[i] = m.ps - b->pkt[i].ps;
+		vm->end[i] = m.pe - b->pkt[i].ps;
+	}
+	return match;
+}
+
+/*
+ *  the test of a WORD node below the root
+ */
+static uint32_t
+vtest(Filter *f, Vmsg *vm, Batch *b, uint32_t live)
+{
+	Vop v;
+
+	if(f->pr == &dump)
+		return sword(f, vm, b, live);
+	memset(&v, 0, sizeof v);
+	v.mask = ~0;
+	if(f->blen){
+		if(byteslower(f, &v))
+			return vword(&v, vm, b, live);
+		return sword(f, vm, b, live);
+	}
+	if(vm->pr->filter == NULL)
+		return 0;
+	if(f->set == NULL && vm->pr->lower && (*vm->pr->lower)(f, &v))
+		return vword(&v, vm, b, live);
+	return sword(f, vm, b, live);
+}
+
+/*
+ *  vtest, for packets that haven't seen this test yet
+ */
+static uint32_t
+vmemotest(Filter *f, Vmsg *vm, Batch *b, uint32_t live)
+{
+	Vmemo *c;
+	Vmsg va;
+	uint32_t todo, ok;
+	int i;
+
+	c = &vmemo[f->memo];
+	if(c->gen != vmemogen){
+		c->gen = vmemogen;
+		c->done = c->ok = 0;
+	}
+	todo = live & ~c->done;
+	if(todo){
+		va = *vm;
+		ok = vtest(f, &va, b, todo);
+		for(i = 0; i < b->n; i++)
+			if(ok & (1<<i)){
+				c->off[i] = va.off[i];
+				c->end[i] = va.end[i];
+			}
+		c->done |= todo;
+		c->ok |= ok;
+	}
+	live &= c->ok;
+	for(i = 0; i < b->n; i++)
+		if(live & (1<<i)){
+			vm->off[i] = c->off[i];
+			vm->end[i] = c->end[i];
+		}
+	return live;
+}
+
+/*
+ *  same walk as _filterpkt, for the packets whose bits are set in live
+ */
+static uint32_t
+_batchfilter(Filter *f, Vmsg *vm, Batch *b, uint32_t live)
+{
+	Vmsg va;
+	uint32_t match;
+
+	if(f == NULL || live == 0)
+		return live;
+
+	switch(f->op){
+	case '!':
+		return live & ~_batchfilter(f->l, vm, b, live);
+	case LAND:
+		va = *vm;
+		match = _batchfilter(f->l, &va, b, live);
+		return _batchfilter(f->r, vm, b, match);
+	case LOR:
+		va = *vm;
+		match = _batchfilter(f->l, &va, b, live);
+		return match | _batchfilter(f->r, vm, b, live & ~match);
+	case WORD:
+		if(vm->needroot && f->pr != &dump){
+			if(vm->pr != f->pr)
+				return 0;
+			vm->needroot = 0;
+		}else if(vm->pr){
+			vm->needroot = 0;
+			if(f->memo)
+				live = vmemotest(f, vm, b, live);
+			else
+				live = vtest(f, vm, b, live);
+		}
+		if(f->l == NULL || live == 0)
+			return live;
+		vm->pr = f->pr;
+		return _batchfilter(f->l, vm, b, live);
+	}
+	sysfatal( "internal error: batchfilter op: %d", f->op);
+	return 0;
+}
+
+uint32_t
+batchfilter(Filter *f, Batch *b, Proto *pr)
+{
+	Vmsg vm;
+	uint32_t live;
+	int i;
+
+	live = (1<<b->n) - 1;
+	memogen++;	/* a new batch, for dump's scans and sniff */
+	if(f == NULL)
+		return live;
+	if(eq == NULL)
+		eq = pickeq();
+	if(nvmemo != nmemo){
+		nvmemo = nmemo;
+		vmemo = realloc(vmemo, (nvmemo+1)*sizeof(Vmemo));
+		if(vmemo == NULL)
+			sysfatal("batchfilter: %r");
+		memset(vmemo, 0, (nvmemo+1)*sizeof(Vmemo));
+		vmemogen = 0;
+	}
+	vmemogen++;
+
+	memset(vm.off, 0, sizeof vm.off);
+	memset(vm.end, 0, sizeof vm.end);
+	for(i = 0; i < b->n; i++)
+		vm.end[i] = b->pkt[i].pe - b->pkt[i].ps;
+	vm.needroot = 1;
+	vm.pr = pr;
+	return _batchfilter(f, &vm, b, live);
+}
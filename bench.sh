@@ -0,0 +1,77 @@
+#!/bin/sh
+# Time snoopy over synthetic traces from gentrace, one per protocol
+# stack, three ways:
+#	filter	a filter that decodes down to the protocol and rejects
+#		everything, so nothing is printed
+#	text	the matching packets formatted as text
+#	trace	the matching packets written as a -d trace
+# and print packets a second and ns a packet for each.  output goes
+# to /dev/null, so this is snoopy and not the disk.
+#
+# usage: bench.sh [-n npkt] [-s seed] [kind...]
+# SNOOPY and GENTRACE say where the binaries are, ./ by default.
+# needs a date that knows %N.
+
+SNOOPY=${SNOOPY:-./snoopy}
+GENTRACE=${GENTRACE:-./gentrace}
+n=200000
+seed=1
+while getopts n:s: c; do
+	case $c in
+	n)	n=$OPTARG;;
+	s)	seed=$OPTARG;;
+	*)	echo "usage: bench.sh [-n npkt] [-s seed] [kind...]" >&2; exit 1;;
+	esac
+done
+shift $((OPTIND-1))
+[ $# -eq 0 ] && set -- tcp dns ip6 gre aoe dhcp
+
+dir=${TMPDIR:-/tmp}/snoopybench.$$
+mkdir -p $dir || exit 1
+trap 'rm -rf $dir' 0
+
+# the filter that picks out each kind's innermost protocol.  dns.c
+# isn't built, so dns is picked out by its port.
+want() {
+	case $1 in
+	tcp)	echo 'tcp';;
+	dns)	echo 'udp(sd=53)';;
+	ip6)	echo 'ip6';;
+	gre)	echo 'gre(ip(udp))';;
+	aoe)	echo 'aoeata';;
+	dhcp)	echo 'dhcp';;
+	esac
+}
+
+ns() {
+	date +%s%N
+}
+
+run() {
+	t0=$(ns)
+	"$@" >/dev/null 2>&1 || { echo "failed: $*" >&2; exit 1; }
+	t1=$(ns)
+	echo $((t1 - t0))
+}
+
+printf '%-6s %-6s %10s %12s %10s\n' kind mode packets pkts/sec ns/pkt
+for k in "$@"; do
+	f=$(want $k)
+	[ -z "$f" ] && { echo "unknown kind $k" >&2; exit 1; }
+	$GENTRACE -n $n -s $seed $k > $dir/$k.trace || exit 1
+	# else text and trace time nothing being printed
+	if [ -z "$($SNOOPY -t -f "$f" $dir/$k.trace 2>/dev/null | head -c 1)" ]; then
+		echo "$f matches nothing in the $k trace" >&2
+		exit 1
+	fi
+	for mode in filter text trace; do
+		case $mode in
+		filter)	t=$(run $SNOOPY -t -f "!$f" $dir/$k.trace);;
+		text)	t=$(run $SNOOPY -t -f "$f" $dir/$k.trace);;
+		trace)	t=$(run $SNOOPY -t -d -f "$f" $dir/$k.trace);;
+		esac
+		[ $t -le 0 ] && t=1
+		printf '%-6s %-6s %10d %12d %10d\n' $k $mode $n \
+			$((n * 1000000000 / t)) $((t / n))
+	done
+done
@@ -113,11 +113,11 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Oca:
-		return NetL(h->ciaddr) == f->ulv || NetL(h->yiaddr) == f->ulv;
+		return fmatch(f, NetL(h->ciaddr)) || fmatch(f, NetL(h->yiaddr));
 	case Osa:
-		return NetL(h->siaddr) == f->ulv;
+		return fmatch(f, NetL(h->siaddr));
 	case Ot:
-		return NetL(h->optmagic) == f->ulv;
+		return fmatch(f, NetL(h->optmagic));
 	}
 	return 0;
 }
@@ -172,6 +172,26 @@ p_seprint(Msg *m)
 	return 0;
 }
 
+/*
+ *  a request or reply with the option magic, on some other port
+ */
+static int
+p_detect(uint8_t *p, uint8_t *e)
+{
+	Hdr *h;
+	uint32_t x;
+
+	h = (Hdr*)p;
+	if(e < (uint8_t*)h->optdata)
+		return 0;
+	if(h->op != Bootrequest && h->op != Bootreply)
+		return 0;
+	if(h->hlen > Maxhwlen)
+		return 0;
+	x = NetL(h->optmagic);
+	return x == genericopt || x == plan9opt;
+}
+
 Proto bootp =
 {
 	"bootp",
@@ -182,4 +202,6 @@ Proto bootp =
 	"%#.8lux",
 	p_fields,
 	defaultframer,
+	NULL,
+	p_detect,
 };
@@ -0,0 +1,277 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  compiled filters as classic BPF, so a linux packet socket only
+ *  hands us packets that might match.  a WORD node whose test its
+ *  module can lower (see Proto.lower) becomes a length check, a load
+ *  and a compare, and the offset of the next header is kept in
+ *  scratch memory, one word per level of WORD nodes.  anything that
+ *  can't be lowered is taken to be true, or false under a !, so the
+ *  kernel passes a superset of what matches and filterpkt still
+ *  decides.
+ */
+#ifdef __linux__
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include "ip.h"
+#include "dat.h"
+#include "protos.h"
+#include "y.tab.h"
+
+enum
+{
+	Maxinsn=	BPF_MAXINSNS,
+	Snap=	0x40000,	/* bytes of an accepted packet to keep */
+};
+
+extern int toflag;
+
+typedef struct Bpf Bpf;
+struct Bpf
+{
+	struct sock_filter	insn[Maxinsn];
+	int	to[Maxinsn];	/* label of a ja, or -1 */
+	int	n;
+
+	int	pc[Maxinsn];	/* where each label is */
+	int	nlabel;
+	int	toolong;
+};
+
+static int
+newlabel(Bpf *b)
+{
+	if(b->nlabel == Maxinsn){
+		b->toolong = 1;
+		return 0;
+	}
+	b->pc[b->nlabel] = -1;
+	return b->nlabel++;
+}
+
+static void
+setlabel(Bpf *b, int l)
+{
+	b->pc[l] = b->n;
+}
+
+static void
+emit(Bpf *b, int code, uint32_t k, int jt, int jf)
+{
+	struct sock_filter *i;
+
+	if(b->n == Maxinsn){
+		b->toolong = 1;
+		return;
+	}
+	i = &b->insn[b->n];
+	i->code = code;
+	i->jt = jt;
+	i->jf = jf;
+	i->k = k;
+	b->to[b->n++] = -1;
+}
+
+static void
+ja(Bpf *b, int l)
+{
+	emit(b, BPF_JMP|BPF_JA, 0, 0, 0);
+	if(!b->toolong)
+		b->to[b->n-1] = l;
+}
+
+/*
+ *  goto l if the compare comes out cond.  conditional jumps only
+ *  reach 255 instructions so they just skip or take a ja.
+ */
+static void
+jif(Bpf *b, int code, uint32_t k, int cond, int l)
+{
+	emit(b, BPF_JMP|code, k, !cond, cond);
+	ja(b, l);
+}
+
+static int
+ldsize(int width)
+{
+	switch(width){
+	case 1:
+		return BPF_B;
+	case 2:
+		return BPF_H;
+	}
+	return BPF_W;
+}
+
+/*
+ *  a lowered test of the header whose offset is in M[d]: fail to
+ *  fl, otherwise leave the offset of the next header in M[d+1]
+ */
+static void
+gentest(Bpf *b, Vop *v, int d, int fl)
+{
+	uint32_t full;
+	int i, ok;
+
+	emit(b, BPF_LDX|BPF_MEM, d, 0, 0);
+	emit(b, BPF_LD|BPF_W|BPF_LEN, 0, 0, 0);
+	jif(b, BPF_JGT|BPF_X, 0, 0, fl);
+	emit(b, BPF_ALU|BPF_SUB|BPF_X, 0, 0, 0);
+	jif(b, BPF_JGE|BPF_K, v->minlen, 0, fl);
+
+	if(v->noff > 0){
+		full = v->width == 4 ? ~0 : (1<<8*v->width) - 1;
+		ok = newlabel(b);
+		for(i = 0; i < v->noff; i++){
+			emit(b, BPF_LD|ldsize(v->width)|BPF_IND, v->off[i], 0, 0);
+			if((v->mask & full) != full)
+				emit(b, BPF_ALU|BPF_AND|BPF_K, v->mask, 0, 0);
+			if(i < v->noff-1)
+				jif(b, BPF_JEQ|BPF_K, v->val, 1, ok);
+			else
+				jif(b, BPF_JEQ|BPF_K, v->val, 0, fl);
+		}
+		setlabel(b, ok);
+	}
+
+	if(v->hmask){
+		emit(b, BPF_LD|BPF_B|BPF_IND, v->hoff, 0, 0);
+		emit(b, BPF_ALU|BPF_AND|BPF_K, v->hmask, 0, 0);
+		emit(b, BPF_ALU|BPF_LSH|BPF_K, 2, 0, 0);
+		if(v->hshift)
+			emit(b, BPF_ALU|BPF_RSH|BPF_K, v->hshift, 0, 0);
+		emit(b, BPF_ALU|BPF_ADD|BPF_K, v->hlen, 0, 0);
+	} else
+		emit(b, BPF_LD|BPF_IMM, v->hlen, 0, 0);
+	emit(b, BPF_ALU|BPF_ADD|BPF_X, 0, 0, 0);
+	emit(b, BPF_ST, d+1, 0, 0);
+}
+
+/*
+ *  the same walk as _batchfilter: go to t if f matches, fl if not.
+ *  pos is 0 under an odd number of !s.
+ */
+static void
+gen(Bpf *b, Filter *f, Proto *pr, int needroot, int d, int t, int fl, int pos)
+{
+	Vop v;
+	int mid;
+
+	if(f == NULL){
+		ja(b, t);
+		return;
+	}
+
+	switch(f->op){
+	case '!':
+		gen(b, f->l, pr, needroot, d, fl, t, !pos);
+		return;
+	case LAND:
+		mid = newlabel(b);
+		gen(b, f->l, pr, needroot, d, mid, fl, pos);
+		setlabel(b, mid);
+		gen(b, f->r, pr, needroot, d, t, fl, pos);
+		return;
+	case LOR:
+		mid = newlabel(b);
+		gen(b, f->l, pr, needroot, d, t, mid, pos);
+		setlabel(b, mid);
+		gen(b, f->r, pr, needroot, d, t, fl, pos);
+		return;
+	case WORD:
+		break;
+	default:
+		sysfatal("internal error: bpf op: %d", f->op);
+	}
+
+	if(needroot && f->pr != &dump){
+		if(pr != f->pr)
+			ja(b, fl);
+		else
+			gen(b, f->l, f->pr, 0, d, t, fl, pos);
+		return;
+	}
+	if(pr == NULL){
+		gen(b, f->l, f->pr, 0, d, t, fl, pos);
+		return;
+	}
+	if(f->pr != &dump && f->blen == 0 && pr->filter == NULL){
+		ja(b, fl);
+		return;
+	}
+
+	memset(&v, 0, sizeof v);
+	v.mask = ~0;
+	if(d+1 >= BPF_MEMWORDS || f->pr == &dump
+	|| (f->blen && !byteslower(f, &v))
+	|| (f->blen == 0 && (f->set != NULL || pr->lower == NULL || !(*pr->lower)(f, &v)))){
+		/* can't tell in the kernel */
+		ja(b, pos ? t : fl);
+		return;
+	}
+	gentest(b, &v, d, fl);
+	gen(b, f->l, f->pr, 0, d+1, t, fl, pos);
+}
+
+/*
+ *  attach the union of the filters to a packet socket whose packets
+ *  start with a pr header.  a NULL filter matches everything.
+ */
+void
+bpfattach(int fd, Filter **f, int nf, Proto *pr)
+{
+	struct sock_fprog prog;
+	Bpf *b;
+	int i, t, fl, next;
+
+	for(i = 0; i < nf; i++)
+		if(f[i] == NULL)
+			return;
+
+	b = calloc(1, sizeof *b);
+	if(b == NULL)
+		sysfatal("bpfattach: %r");
+	t = newlabel(b);
+	fl = newlabel(b);
+
+	emit(b, BPF_LD|BPF_IMM, 0, 0, 0);
+	emit(b, BPF_ST, 0, 0, 0);
+	for(i = 0; i < nf; i++){
+		next = i < nf-1 ? newlabel(b) : fl;
+		gen(b, f[i], pr, 1, 0, t, next, 1);
+		if(next != fl)
+			setlabel(b, next);
+	}
+	setlabel(b, t);
+	emit(b, BPF_RET|BPF_K, Snap, 0, 0);
+	setlabel(b, fl);
+	emit(b, BPF_RET|BPF_K, 0, 0, 0);
+
+	if(b->toolong){
+		fprintf(stderr, "filter too long for the kernel\n");
+		free(b);
+		return;
+	}
+	for(i = 0; i < b->n; i++)
+		if(b->to[i] >= 0)
+			b->insn[i].k = b->pc[b->to[i]] - (i+1);
+
+	prog.len = b->n;
+	prog.filter = b->insn;
+	if(setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof prog) < 0)
+		fprintf(stderr, "can't attach kernel filter: %s\n", strerror(errno));
+	else if(!toflag)
+		fprintf(stderr, "kernel filter: %d instructions\n", b->n);
+	free(b);
+}
+#endif
@@ -0,0 +1,136 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  proto[off:len]=hex or proto[off:len]=hex/mask, a compare of len
+ *  bytes at off from the start of proto's header, for fields the
+ *  module doesn't name.  complete() hangs the compare under a proto
+ *  node so it gets the header like any other field.  the value and
+ *  mask go in f->a, the mask already applied to the value.
+ */
+#include "ip.h"
+#include <ctype.h>
+#include "dat.h"
+#include "y.tab.h"
+
+enum
+{
+	Nbytes=	16,	/* longest compare, half of Filter.a */
+};
+
+/*
+ *  hex digits, right justified in n bytes
+ */
+static void
+parsehex(uint8_t *to, int n, char *s)
+{
+	char *p, *e;
+	int i, d;
+
+	if(s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+		s += 2;
+	for(e = s; isxdigit(*e); e++)
+		;
+	if(e == s || (*e != 0 && *e != '/'))
+		sysfatal("bad hex value: %s", s);
+	if(e - s > 2*n)
+		sysfatal("hex value longer than %d bytes: %s", n, s);
+
+	memset(to, 0, n);
+	for(p = e-1, i = 2*n-1; p >= s; p--, i--){
+		d = isdigit(*p) ? *p - '0' : tolower(*p) - 'a' + 10;
+		to[i/2] |= i&1 ? d : d<<4;
+	}
+}
+
+/*
+ *  compile [off:len] = value[/mask]
+ */
+void
+compile_bytes(Filter *f)
+{
+	char *p, *e;
+	uint8_t *val, *mask;
+	int i, off, len;
+
+	if(f->r->op == '@')
+		sysfatal("no sets of byte arrays: %s", f->l->s);
+	p = f->l->s + 1;
+	off = strtol(p, &e, 0);
+	len = 1;
+	if(*e == ':')
+		len = strtol(e+1, &e, 0);
+	if(e == p || *e != ']' || e[1] != 0 || off < 0)
+		sysfatal("bad byte offset: %s", f->l->s);
+	if(len < 1 || len > Nbytes)
+		sysfatal("byte compares are 1 to %d long: %s", Nbytes, f->l->s);
+
+	val = f->a;
+	mask = f->a + Nbytes;
+	parsehex(val, len, f->r->s);
+	p = strchr(f->r->s, '/');
+	if(p != NULL)
+		parsehex(mask, len, p+1);
+	else
+		memset(mask, 0xff, len);
+	for(i = 0; i < len; i++)
+		val[i] &= mask[i];
+
+	f->op = WORD;
+	f->param = off;
+	f->blen = len;
+	f->l = f->r = NULL;
+}
+
+int
+bytesmatch(Filter *f, Msg *m)
+{
+	uint8_t *p, *val, *mask;
+	int i;
+
+	if(m->pe - m->ps < f->param + f->blen)
+		return 0;
+	p = m->ps + f->param;
+	val = f->a;
+	mask = f->a + Nbytes;
+	for(i = 0; i < f->blen; i++)
+		if((p[i] & mask[i]) != val[i])
+			return 0;
+	return 1;
+}
+
+/*
+ *  1, 2 and 4 byte compares are a masked load for batchfilter.
+ *  the header isn't skipped, the compare is never followed by
+ *  another header.
+ */
+int
+byteslower(Filter *f, Vop *v)
+{
+	if(f->blen == 3 || f->blen > 4)
+		return 0;
+	v->minlen = f->param + f->blen;
+	v->width = f->blen;
+	v->off[v->noff++] = f->param;
+	switch(f->blen){
+	case 1:
+		v->val = f->a[0];
+		v->mask = f->a[Nbytes];
+		break;
+	case 2:
+		v->val = NetS(f->a);
+		v->mask = NetS(f->a + Nbytes);
+		break;
+	case 4:
+		v->val = NetL(f->a);
+		v->mask = NetL(f->a + Nbytes);
+		break;
+	}
+	return 1;
+}
@@ -62,13 +62,13 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Otype:
-		return h->type == f->ulv;
+		return fmatch(f, h->type);
 	case Oconn:
-		return h->conn = f->ulv;
+		return fmatch(f, h->conn);
 	case Oseq:
-		return h->seq = f->ulv;
+		return fmatch(f, h->seq);
 	case Olen:
-		return h->len = f->ulv;
+		return fmatch(f, h->len);
 	}
 	return 0;
 }
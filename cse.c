@@ -0,0 +1,133 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  common subexpressions in compiled filters.  where a WORD node
+ *  starts is decided by the chain of WORD nodes above it, so two
+ *  nodes with the same test under the same chain see the same header
+ *  and get the same answer.  each distinct (chain, test) pair gets a
+ *  memo id; the ids form a DAG shared by every compiled filter.
+ *  filterword and batchfilter cache a test's result and the offset
+ *  of the next header by id, so each header is decoded at most once
+ *  per packet however many branches of the filter look at it.
+ */
+#include "ip.h"
+#include "dat.h"
+#include "y.tab.h"
+
+typedef struct Cse Cse;
+struct Cse
+{
+	Filter	*f;
+	int	ctx;	/* memo id of the enclosing WORD node */
+	Cse	*next;
+};
+
+enum
+{
+	Ncsehash=	4096,
+};
+
+static Cse	*csehash[Ncsehash];
+
+Memo	*memo;
+int	nmemo;
+uint32_t	memogen;
+
+static uint32_t
+csehashfn(Filter *f, int ctx)
+{
+	uint32_t h;
+	int i;
+
+	h = ctx*31 + f->subop;
+	h = h*31 + f->param;
+	h = h*31 + (uintptr_t)f->pr;
+	for(i = 0; i < sizeof f->a; i++)
+		h = h*31 + f->a[i];
+	return h % Ncsehash;
+}
+
+static int
+lookup(Filter *f, int ctx)
+{
+	Cse *c;
+	uint32_t h;
+
+	h = csehashfn(f, ctx);
+	for(c = csehash[h]; c != NULL; c = c->next)
+		if(c->ctx == ctx && sametest(c->f, f))
+			return c->f->memo;
+
+	c = malloc(sizeof *c);
+	if(c == NULL)
+		sysfatal("cse: %r");
+	c->f = f;
+	c->ctx = ctx;
+	c->next = csehash[h];
+	csehash[h] = c;
+	return ++nmemo;
+}
+
+static void
+_cse(Filter *f, int ctx)
+{
+	if(f == NULL)
+		return;
+
+	switch(f->op){
+	case WORD:
+		f->memo = lookup(f, ctx);
+		_cse(f->l, f->memo);
+		break;
+	default:
+		_cse(f->l, ctx);
+		_cse(f->r, ctx);
+		break;
+	}
+}
+
+/*
+ *  number the tests in a compiled filter and size the cache
+ */
+void
+cse(Filter *f)
+{
+	_cse(f, 0);
+	memo = realloc(memo, (nmemo+1)*sizeof(Memo));
+	if(memo == NULL)
+		sysfatal("cse: %r");
+	memset(memo, 0, (nmemo+1)*sizeof(Memo));
+	memogen = 0;
+}
+
+/*
+ *  forget the tests made so far, for packets that have nothing to
+ *  do with the ones before
+ */
+void
+memoreset(void)
+{
+	if(memo != NULL)
+		memset(memo, 0, (nmemo+1)*sizeof(Memo));
+	memogen = 0;
+}
+
+/*
+ *  do two compiled WORD nodes test the same thing?
+ */
+int
+sametest(Filter *a, Filter *b)
+{
+	return a->op == WORD && b->op == WORD
+		&& a->pr == b->pr && a->subop == b->subop
+		&& a->param == b->param && a->set == b->set
+		&& a->blen == b->blen
+		&& memcmp(a->a, b->a, sizeof a->a) == 0;
+}
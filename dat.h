@@ -13,6 +13,7 @@
 #include <iplib/iplib.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <limits.h>
 
@@ -24,11 +25,27 @@ typedef struct Filter Filter;
 typedef struct Msg Msg;
 typedef struct Mux Mux;
 typedef struct Proto Proto;
+typedef struct Vop Vop;
+typedef struct Pkt Pkt;
+typedef struct Batch Batch;
+typedef struct Pbuf Pbuf;
+typedef struct Memo Memo;
+typedef struct Set Set;
+typedef struct Lpm Lpm;
+typedef struct Ac Ac;
+typedef struct Flow Flow;
+typedef struct Stats Stats;
 
 #define NetS(x) ((((uint8_t*)x)[0]<<8) | ((uint8_t*)x)[1])
 #define Net3(x) ((((uint8_t*)x)[0]<<16) | (((uint8_t*)x)[1]<<8) | ((uint8_t*)x)[2])
 #define NetL(x) ((((uint8_t*)x)[0]<<24) | (((uint8_t*)x)[1]<<16) | (((uint8_t*)x)[2]<<8) | ((uint8_t*)x)[3])
 
+/*
+ *  compare a header field with the filter's value or set of values
+ */
+#define fmatch(f, v) ((f)->set ? setmatch((f)->set, (v)) : (v) == (f)->ulv)
+#define fmatch6(f, x) ((f)->set ? setmatch6((f)->set, (x)) : memcmp((x), (f)->a, IPaddrlen) == 0)
+
 /*
  *  one per protocol module
  */
@@ -42,6 +59,8 @@ struct Proto
 	char*	valfmt;
 	Field*	field;
 	int	(*framer)(int, uint8_t*, int);
+	int	(*lower)(Filter*, Vop*);
+	int	(*detect)(uint8_t*, uint8_t*);	/* see sniff.c */
 };
 extern Proto *protos[];
 
@@ -101,9 +120,13 @@ struct Filter {
 
 	Proto	*pr;	/* next protocol;*/
 
+	int	memo;	/* common subexpression id, see cse.c */
+
 	/* protocol specific */
 	int	subop;
 	uint32_t	param;
+	Set	*set;	/* values to match instead of ulv */
+	int	blen;	/* proto[off:len] compare, see bytes.c */
 	union {
 		uint32_t	ulv;
 		int64_t	vlv;
@@ -111,17 +134,210 @@ struct Filter {
 	};
 };
 
+/*
+ *  a filter node lowered to a compare at fixed offsets in the
+ *  header, see Proto.lower.  the header length is
+ *  hlen + (((h[hoff]&hmask)<<2)>>hshift).
+ */
+struct Vop
+{
+	int	minlen;		/* header must be at least this long */
+	int	hlen;
+	int	hoff;
+	int	hmask;
+	int	hshift;
+
+	int	noff;		/* number of field offsets, any may match */
+	int	off[2];
+	int	width;		/* field width: 1, 2 or 4 bytes */
+	uint32_t	mask;		/* applied to the field first */
+	uint32_t	val;
+};
+
+enum
+{
+	Nbatch=	16,	/* packets filtered together */
+	Pktlen=	64*1024,
+	Headroom=	32,	/* before each packet, for tracepkt's headers */
+};
+
+/*
+ *  what -P times, see prof.c
+ */
+enum
+{
+	Pread,
+	Pfilter,
+	Pwrite,
+	Pdecode,	/* a Proto's filter */
+	Pprint,		/* a Proto's seprint */
+};
+
+/*
+ *  a buffer from the packet pool, see pool.c.  the packet goes at
+ *  base+Headroom.
+ */
+struct Pbuf
+{
+	int	ref;
+	uint8_t	*base;
+	Pbuf	*next;		/* on the free list */
+};
+
+/*
+ *  a packet and a batch of them.  buf is the pool buffer holding
+ *  the packet, nil if it's somewhere else, like a packet ring.
+ */
+struct Pkt
+{
+	uint8_t	*ps;
+	uint8_t	*pe;
+	int64_t	time;
+	Pbuf	*buf;
+};
+
+struct Batch
+{
+	int	n;
+	Pkt	pkt[Nbatch];
+};
+
+/*
+ *  the result of a WORD test for the current packet, by memo id
+ */
+struct Memo
+{
+	uint32_t	gen;
+	int	ok;
+	uint8_t	*ps;	/* the next header */
+	uint8_t	*pe;	/* and its end, which a test can shorten */
+};
+/*
+ *  an ip conversation, see flow.c.  v4 addresses are v4-in-v6.
+ */
+struct Flow
+{
+	uint8_t	src[IPaddrlen];
+	uint8_t	dst[IPaddrlen];
+	uint16_t	sport;
+	uint16_t	dport;
+	uint8_t	proto;
+	uint8_t	*l4;	/* tcp or udp header, if any */
+	uint8_t	*end;	/* of the ip payload, by its length */
+};
+
+/*
+ *  counts kept by each capture worker and summed at the end
+ */
+struct Stats
+{
+	uint64_t	pkts;		/* seen by the kernel */
+	uint64_t	drops;		/* dropped by the kernel */
+	uint64_t	match;
+	uint64_t	sampled;	/* thrown away by -K or -S */
+	uint64_t	limited;	/* thrown away by -R */
+};
+extern Stats	*stats;
+
+extern Memo	*memo;
+extern int	nmemo;
+extern uint32_t	memogen;
+
 extern void	yyinit(char*);
 extern int	yyparse(void);
 extern Filter*	newfilter(void);
 extern void	compile_cmp(char*, Filter*, Field*);
+extern void	compile_bytes(Filter*);
+extern int	bytesmatch(Filter*, Msg*);
+extern int	byteslower(Filter*, Vop*);
 extern void	demux(Mux*, uint32_t, uint32_t, Msg*, Proto*);
 extern int	defaultframer(int, uint8_t*, int);
+extern Proto*	sniff(Proto*, int, int, uint8_t*, uint8_t*);
+extern void	sniffreset(void);
+extern void	udpreset(void);
+extern void	dumpreset(void);
+extern uint32_t	batchfilter(Filter*, Batch*, Proto*);
+extern int	filterword(Filter*, Msg*);
+extern int	wordtest(Filter*, Msg*);
+extern int	skiphdrs(Msg*);
+extern void	cse(Filter*);
+extern void	memoreset(void);
+extern int	isset(char*, int);
+extern Set*	parseset(char*, int);
+extern Set*	loadset(char*, int);
+extern int	setmatch(Set*, uint32_t);
+extern int	setmatch6(Set*, uint8_t*);
+extern Lpm*	mklpm(void);
+extern void	lpmadd(Lpm*, uint8_t*, int, int);
+extern int	lpmmatch(Lpm*, uint8_t*, int);
+extern int	lpmmatch4(Lpm*, uint32_t);
+extern Ac*	mkac(void);
+extern int	acadd(Ac*, uint8_t*, int);
+extern int	acnpat(Ac*);
+extern void	acscan(Ac*, uint8_t*, uint8_t*, uint32_t*);
+extern int	sametest(Filter*, Filter*);
+extern int	flowkey(Flow*, uint8_t*, uint8_t*, Proto*);
+extern uint32_t	flowhash(Flow*);
+extern uint64_t	hash64(uint8_t*, int);
+extern int	sample(Pkt*);
+extern void	addstats(Stats*);
+extern void	printstats(void);
+extern int	openworkers(const char*, int, char*);
+extern int	packetbatch(int, Batch*);
+extern void	packetstats(int);
+extern void	bpfattach(int, Filter**, int, Proto*);
+extern void*	bigalloc(size_t);
+extern void	numabind(char*, const char*);
+extern uint64_t	cycles(void);
+extern void	profinit(void);
+extern void	profadd(int, Proto*, uint64_t);
+extern void	profaddn(int, Proto*, uint64_t, int);
+extern void	profprint(void);
+extern void	profcheck(void);
+extern void	hieradd(Pkt*);
+extern void	hierprint(void);
+extern void	topadd(Pkt*);
+extern void	topprint(void);
+extern void	estadd(Pkt*);
+extern void	estprint(void);
+extern void	rttadd(Pkt*);
+extern void	rttprint(void);
+extern void	rtpadd(Pkt*);
+extern void	rtpprint(void);
+extern Pbuf*	pballoc(void);
+extern void	pbref(Pbuf*);
+extern void	pbfree(Pbuf*);
+extern void	pbpool(uint8_t**, size_t*);
+extern void	batchfree(Batch*);
+extern int	uringinit(int);
+extern void	uwrite(int, char*, int);
+extern void	uwritepkt(int, char*, int, Pbuf*);
+extern int	uwait(void);
+extern void	uflush(int);
+extern int	uread(int, Batch*);
+extern void	addmfilter(Filter*, int);
+extern uint32_t	mfilterpkt(uint8_t*, uint8_t*, Proto*);
 
 extern int Mflag;
 extern int Nflag;
 extern int dflag;
 extern int Cflag;
+extern int Kflag;
+extern int Sflag;
+extern int Rflag;
+extern int Uflag;
+extern int Gflag;
+extern int Pflag;
+extern int Hflag;
+extern int Hival;
+extern int Tflag;
+extern int Tival;
+extern int Eflag;
+extern int Eival;
+extern int Lflag;
+extern int Lival;
+extern int Qflag;
+extern int Qival;
 
 typedef Filter *Filterptr;
 #define YYSTYPE Filterptr
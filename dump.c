@@ -10,12 +10,311 @@
 
 #include "ip.h"
 #include <ctype.h>
+#include <regex.h>
 #include "dat.h"
 #include "protos.h"
+#include "y.tab.h"
+
+/*
+ *  dump(contains=s) and dump(re=e) look at the bytes dump would
+ *  print, whatever is left below the deepest header we decode.
+ *  every contains in the filters goes into one Aho-Corasick
+ *  automaton, run at most once per packet; a test just looks up
+ *  its pattern's bit.
+ */
+enum
+{
+	Ocontains,
+	Ore,
+
+	Nscan=	2*Nbatch,	/* cached scans, see scan() */
+};
+
+static Field p_fields[] =
+{
+	{"contains",	Fba,	Ocontains,	"payload contains string",	} ,
+	{"re",		Fba,	Ore,		"payload matches regular expression",	} ,
+	{0}
+};
+
+/*
+ *  the patterns found in one packet's payload
+ */
+typedef struct Scan Scan;
+struct Scan
+{
+	uint32_t	gen;
+	uint8_t	*ps;
+	uint8_t	*pe;
+	uint32_t	*hit;
+	int	nhit;
+};
+
+static Ac	*ac;
+static Scan	scans[Nscan];
+static regex_t	*res;
+static int	nres;
+
+/*
+ *  undo \\, \", \t, \r, \n and \xNN in place, return the length
+ */
+static int
+unescape(char *s)
+{
+	char *p, *q, x[3];
+
+	for(p = q = s; *p; p++){
+		if(*p != '\\' || p[1] == 0){
+			*q++ = *p;
+			continue;
+		}
+		switch(*++p){
+		case 't':
+			*q++ = '\t';
+			break;
+		case 'r':
+			*q++ = '\r';
+			break;
+		case 'n':
+			*q++ = '\n';
+			break;
+		case 'x':
+			if(!isxdigit(p[1]) || !isxdigit(p[2]))
+				sysfatal("bad \\x escape in pattern: %s", s);
+			x[0] = p[1];
+			x[1] = p[2];
+			x[2] = 0;
+			*q++ = strtoul(x, NULL, 16);
+			p += 2;
+			break;
+		default:
+			*q++ = *p;
+			break;
+		}
+	}
+	*q = 0;
+	return q - s;
+}
 
 static void
-p_compile(Filter *_)
+p_compile(Filter *f)
+{
+	Field *fld;
+	char *s, err[128];
+	int n, r;
+
+	if(f->op != '=')
+		sysfatal("unknown dump field: %s", f->s);
+	for(fld = p_fields; fld->name != NULL; fld++)
+		if(strcmp(f->l->s, fld->name) == 0)
+			break;
+	if(fld->name == NULL)
+		sysfatal("unknown dump field in: %s = %s", f->l->s, f->r->s);
+
+	s = strdup(f->r->s);
+	if(s == NULL)
+		sysfatal("dump: %r");
+	switch(fld->subop){
+	case Ocontains:
+		n = unescape(s);
+		if(ac == NULL)
+			ac = mkac();
+		f->param = acadd(ac, (uint8_t*)s, n);
+		free(s);
+		break;
+	case Ore:
+		res = realloc(res, (nres+1)*sizeof(regex_t));
+		if(res == NULL)
+			sysfatal("dump: %r");
+		r = regcomp(&res[nres], s, REG_EXTENDED|REG_NOSUB);
+		if(r != 0){
+			regerror(r, &res[nres], err, sizeof err);
+			sysfatal("bad regular expression %s: %s", s, err);
+		}
+		free(s);
+		f->param = nres++;
+		break;
+	}
+	f->op = WORD;
+	f->subop = fld->subop;
+	f->l = f->r = NULL;
+}
+
+/*
+ *  the patterns in ps..pe, scanning only the first time a packet
+ *  is asked about.  filterpkt, mfilterpkt and batchfilter bump
+ *  memogen for each packet or batch, and a batch's packets don't
+ *  overlap, so (memogen, ps, pe) names one payload.
+ */
+static uint32_t*
+scan(uint8_t *ps, uint8_t *pe)
 {
+	Scan *s;
+	int n;
+
+	s = &scans[((uintptr_t)ps * 2654435761U >> 8) % Nscan];
+	if(s->gen == memogen && s->ps == ps && s->pe == pe && s->hit != NULL)
+		return s->hit;
+
+	n = (acnpat(ac)+31)/32;
+	if(s->nhit < n){
+		s->hit = realloc(s->hit, n*sizeof(uint32_t));
+		if(s->hit == NULL)
+			sysfatal("dump: %r");
+		s->nhit = n;
+	}
+	memset(s->hit, 0, n*sizeof(uint32_t));
+	acscan(ac, ps, pe, s->hit);
+	s->gen = memogen;
+	s->ps = ps;
+	s->pe = pe;
+	return s->hit;
+}
+
+/*
+ *  forget the cached scans, whose buffers may be reused
+ */
+void
+dumpreset(void)
+{
+	int i;
+
+	for(i = 0; i < Nscan; i++){
+		scans[i].gen = 0;
+		scans[i].ps = scans[i].pe = NULL;
+	}
+}
+
+static int
+p_filter(Filter *f, Msg *m)
+{
+	regmatch_t pm;
+	uint32_t *hit;
+
+	switch(f->subop){
+	case Ocontains:
+		hit = scan(m->ps, m->pe);
+		return (hit[f->param>>5] & (1u<<(f->param&31))) != 0;
+	case Ore:
+		pm.rm_so = 0;
+		pm.rm_eo = m->pe - m->ps;
+		return regexec(&res[f->param], (char*)m->ps, 1, &pm, REG_STARTEND) == 0;
+	}
+	return 0;
+}
+
+/*
+ *  the protocols pr demuxes to, each as the WORD filter pr's compile
+ *  makes of it, so skiphdrs can walk with pr's filter.  a name under
+ *  several values gets a filter for each.
+ */
+typedef struct Kids Kids;
+struct Kids
+{
+	Proto	*pr;
+	Filter	**f;
+	int	n;
+	Kids	*next;
+};
+
+enum
+{
+	Nkids=	64,
+};
+
+static Kids	*kids[Nkids];
+
+static Kids*
+kidsof(Proto *pr)
+{
+	Kids *k, **l;
+	Filter *f;
+	Mux *mx;
+	int n;
+
+	l = &kids[((uintptr_t)pr >> 4) % Nkids];
+	for(k = *l; k != NULL; k = k->next)
+		if(k->pr == pr)
+			return k;
+
+	k = calloc(1, sizeof(*k));
+	if(k == NULL)
+		sysfatal("dump: %r");
+	k->pr = pr;
+	n = 0;
+	if(pr->mux != NULL && pr->compile != NULL && pr->filter != NULL)
+		for(mx = pr->mux; mx->name != NULL; mx++)
+			n++;
+	if(n > 0){
+		k->f = calloc(n, sizeof(Filter*));
+		if(k->f == NULL)
+			sysfatal("dump: %r");
+		for(mx = pr->mux; n > 0 && mx->name != NULL; mx++){
+			if(mx->pr == NULL || mx->pr == &dump)
+				continue;
+			f = newfilter();
+			f->op = WORD;
+			f->s = mx->name;
+			(*pr->compile)(f);
+			if(f->pr != mx->pr){
+				free(f);
+				continue;
+			}
+			f->ulv = mx->val;
+			k->f[k->n++] = f;
+		}
+	}
+	k->next = *l;
+	*l = k;
+	return k;
+}
+
+/*
+ *  skip the headers below m->pr to get to the bytes dump would
+ *  print.  a header is stepped over by its module's filter, testing
+ *  for the protocols it demuxes to; a header none of them is under is
+ *  the last.  the filters change nothing but udp's, which learns rtp
+ *  ports as it tests for rtp and rtcp; that's safe to run again here
+ *  because learn counts a packet it has seen before once (see the
+ *  d == 0 check in udp.c).  a module that demuxes to nothing is a
+ *  leaf, and decoding its header without formatting is safe.  a
+ *  header too short to decode is left as part of the payload.
+ */
+int
+skiphdrs(Msg *m)
+{
+	Proto *pr;
+	Kids *k;
+	Msg ma;
+	char buf[1];
+	int i;
+
+	pr = m->pr;
+	while(pr != NULL && pr != &dump && m->ps < m->pe){
+		k = kidsof(pr);
+		if(k->n == 0){
+			ma = *m;
+			ma.pr = pr;
+			ma.p = ma.e = buf;
+			if((*pr->seprint)(&ma) < 0)
+				break;
+			m->ps = ma.ps;
+			pr = ma.pr;
+			continue;
+		}
+		for(i = 0; i < k->n; i++){
+			ma = *m;
+			if((*pr->filter)(k->f[i], &ma))
+				break;
+		}
+		if(ma.ps > m->pe)
+			break;
+		m->ps = ma.ps;
+		if(i == k->n)
+			break;
+		pr = k->f[i]->pr;
+	}
+	return 1;
 }
 
 static char tohex[16] = {
@@ -101,10 +400,10 @@ Proto dump =
 {
 	"dump",
 	p_compile,
-	NULL,
+	p_filter,
 	p_seprint,
 	NULL,
 	NULL,
-	NULL,
+	p_fields,
 	defaultframer,
 };
@@ -120,7 +120,7 @@ p_filter(Filter *f, Msg *m)
 		return 0;
 	m->ps += TPHDR;
 
-	if(h->tp == f->ulv)
+	if(fmatch(f, h->tp))
 		return 1;
 
 	return 0;
@@ -77,7 +77,7 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Ot:
-		return h->type == f->ulv;
+		return fmatch(f, h->type);
 	}
 	return 0;
 }
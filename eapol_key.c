@@ -80,7 +80,7 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Odesc:
-		return h->desc == f->ulv;
+		return fmatch(f, h->desc);
 	}
 	return 0;
 }
@@ -94,11 +94,28 @@ p_filter(Filter *f, Msg *m)
 	case Oa:
 		return memcmp(h->s, f->a, 6) == 0 || memcmp(h->d, f->a, 6) == 0;
 	case Ot:
-		return NetS(h->type) == f->ulv;
+		return fmatch(f, NetS(h->type));
 	}
 	return 0;
 }
 
+/*
+ *  only the type is at a fixed offset
+ */
+static int
+p_lower(Filter *f, Vop *v)
+{
+	if(f->subop != Ot)
+		return 0;
+	v->minlen = ETHERHDRSIZE;
+	v->hlen = ETHERHDRSIZE;
+	v->noff = 1;
+	v->off[0] = offsetof(Hdr, type);
+	v->width = 2;
+	v->val = f->ulv;
+	return 1;
+}
+
 static int
 p_seprint(Msg *m)
 {
@@ -130,5 +147,6 @@ Proto ether =
 	p_mux,
 	"%#.4lux",
 	p_fields,
-	defaultframer
+	defaultframer,
+	p_lower,
 };
@@ -19,6 +19,7 @@ void yyerror(char*_);
 %term LAND
 %term WORD
 %term NE
+%term IN
 %right '!'
 %left '|'
 %left '&'
@@ -42,6 +43,10 @@ expr		: WORD
 			  $2->op = '!';
 			  $$ = $2;
 			}
+		| WORD '@' WORD
+			{ $2->l = $1; $2->r = $3; $$ = $2; }
+		| WORD IN WORD
+			{ $2->op = '='; $2->l = $1; $2->r = $3; $$ = $2; }
 		| WORD '(' expr ')'
 			{ $1->l = $3; free($2); free($4); $$ = $1; }
 		| '(' expr ')'
@@ -55,6 +60,19 @@ expr		: WORD
 		;
 %%
 
+/*
+ *  `in' is the only keyword
+ */
+static int
+wordtok(void)
+{
+	if(strcmp(yylval->s, "in") == 0){
+		yylval->op = IN;
+		return IN;
+	}
+	return WORD;
+}
+
 /*
  *  Initialize the parsing.  Done once for each header field.
  */
@@ -79,14 +97,38 @@ yylex(void)
 
 	yylval = newfilter();
 
-	p = strpbrk(yylp, "!|&()= ");
+	/* a quoted string is one word, never a keyword; \" doesn't end it */
+	if(*yylp == '"'){
+		for(p = yylp+1; *p && *p != '"'; p++)
+			if(*p == '\\' && p[1])
+				p++;
+		if(*p == 0)
+			sysfatal("parsing filter: missing \"");
+		yylval->op = WORD;
+		yylval->s = strndup(yylp+1, p-yylp-1);
+		if(yylval->s == NULL)
+			sysfatal("parsing filter: %r");
+		yylp = p+1;
+		return WORD;
+	}
+
+	/* a set is one word, spaces and all */
+	if(*yylp == '{'){
+		p = strchr(yylp, '}');
+		if(p == 0)
+			sysfatal("parsing filter: missing }");
+		p++;
+		if(*p == 0)
+			p = 0;
+	} else
+		p = strpbrk(yylp, "!|&()=@ ");
 	if(p == 0){
 		yylval->op = WORD;
 		yylval->s = strdup(yylp);
 		if(yylval->s == NULL)
 			sysfatal("parsing filter: %r");
 		yylp = NULL;
-		return WORD;
+		return wordtok();
 	}
 	c = *p;
 	if(p != yylp){
@@ -97,7 +139,7 @@ yylex(void)
 			sysfatal("parsing filter: %r");
 		*p = c;
 		yylp = p;
-		return WORD;
+		return wordtok();
 	}
 
 	yylp++;
@@ -0,0 +1,158 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  the addresses, ports and protocol of an ip or ip6 packet, read
+ *  straight from the headers at their fixed offsets for the things
+ *  that need a flow before, or instead of, decoding the packet.
+ *  ip6 extension headers aren't followed, such packets get no ports.
+ */
+#include "ip.h"
+#include "dat.h"
+#include "protos.h"
+
+enum
+{
+	Etherlen=	14,
+	Ip4len=	20,
+	Ip6len=	40,
+
+	Ttcp=	6,
+	Tudp=	17,
+};
+
+/*
+ *  fill in fl from the packet at ps, which starts with a pr header.
+ *  returns 0 if it isn't ip.
+ */
+int
+flowkey(Flow *fl, uint8_t *ps, uint8_t *pe, Proto *pr)
+{
+	uint8_t *l4;
+	int v, hl;
+
+	memset(fl, 0, sizeof *fl);
+	if(pr == &ether){
+		if(pe - ps < Etherlen)
+			return 0;
+		switch(NetS(ps+12)){
+		case 0x0800:
+			pr = &ip;
+			break;
+		case 0x86dd:
+			pr = &ip6;
+			break;
+		default:
+			return 0;
+		}
+		ps += Etherlen;
+	}
+
+	if(pr == &ip){
+		if(pe - ps < Ip4len)
+			return 0;
+		v = ps[0] >> 4;
+		hl = (ps[0] & 0xf) << 2;
+		if(v != 4 || hl < Ip4len)
+			return 0;
+		v4tov6(fl->src, ps+12);
+		v4tov6(fl->dst, ps+16);
+		fl->proto = ps[9];
+		fl->end = ps + NetS(ps+2);
+		if(fl->end > pe)
+			fl->end = pe;
+		/* only the first fragment has the ports */
+		if(NetS(ps+6) & 0x1fff)
+			return 1;
+		l4 = ps + hl;
+	} else if(pr == &ip6){
+		if(pe - ps < Ip6len)
+			return 0;
+		memmove(fl->src, ps+8, IPaddrlen);
+		memmove(fl->dst, ps+24, IPaddrlen);
+		fl->proto = ps[6];
+		fl->end = ps + Ip6len + NetS(ps+4);
+		if(fl->end > pe)
+			fl->end = pe;
+		l4 = ps + Ip6len;
+	} else
+		return 0;
+
+	if(fl->proto == Ttcp || fl->proto == Tudp){
+		if(pe - l4 < 4)
+			return 1;
+		fl->sport = NetS(l4);
+		fl->dport = NetS(l4+2);
+		fl->l4 = l4;
+	}
+	return 1;
+}
+
+static uint32_t
+hashbytes(uint32_t h, uint8_t *p, int n)
+{
+	while(n-- > 0)
+		h = (h ^ *p++) * 16777619;
+	return h;
+}
+
+/*
+ *  the same for both directions of a conversation
+ */
+uint32_t
+flowhash(Flow *fl)
+{
+	uint8_t *a, *b;
+	uint16_t pa, pb;
+	uint8_t x[4];
+	uint32_t h;
+	int c;
+
+	a = fl->src;
+	b = fl->dst;
+	pa = fl->sport;
+	pb = fl->dport;
+	c = memcmp(a, b, IPaddrlen);
+	if(c > 0 || (c == 0 && pa > pb)){
+		a = fl->dst;
+		b = fl->src;
+		pa = fl->dport;
+		pb = fl->sport;
+	}
+	h = 2166136261U;
+	h = hashbytes(h, a, IPaddrlen);
+	h = hashbytes(h, b, IPaddrlen);
+	hnputs(x, pa);
+	hnputs(x+2, pb);
+	h = hashbytes(h, x, 4);
+	h = hashbytes(h, &fl->proto, 1);
+
+	/* fnv is weak in the low bits, mix them */
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	return h;
+}
+
+/*
+ *  a 64 bit hash of any key, fnv with the low bits mixed
+ */
+uint64_t
+hash64(uint8_t *p, int n)
+{
+	uint64_t h;
+
+	h = 14695981039346656037ULL;
+	while(n-- > 0)
+		h = (h ^ *p++) * 1099511628211ULL;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
@@ -0,0 +1,330 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  a fuzzing target for the protocol modules.  an input's first byte
+ *  picks the root protocol, by its place in protos[], and the rest is
+ *  the packet.  it goes through filterpkt once for each protocol that
+ *  can be reached from the root, with a filter that runs that
+ *  protocol's own filter (see mkfilters), and then seprintpkt.
+ *  the packet is copied to a buffer of its own size, so a sanitizer
+ *  sees any read past the end.
+ *
+ *  built with -DLIBFUZZER, libFuzzer drives LLVMFuzzerTestOneInput.
+ *  otherwise main runs it once on each file named, or on standard
+ *  input, for afl or for replaying a crash.  afl's persistent mode is
+ *  used if the compiler has it.
+ *
+ *	fuzz -c dir [-h first-header] trace...
+ *
+ *  writes the traces' packets into dir as a seed corpus.
+ *
+ *  linked with snoopy's objects, whose main the Makefile renames.
+ */
+#include "ip.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include "dat.h"
+#include "protos.h"
+#include "y.tab.h"
+
+#undef main
+
+enum
+{
+	Nseed=	256,	/* packets from each trace */
+	Outlen=	16*1024,
+	Maxin=	64*1024,
+	Maxproto=	256,
+};
+
+extern Proto	*root;
+extern int	toflag;
+extern int64_t	starttime;
+extern Filter*	newfilter(void);
+extern Filter*	compile(Filter*);
+extern int	filterpkt(Filter*, uint8_t*, uint8_t*, Proto*, int);
+extern char*	seprintpkt(char*, char*, uint8_t*, uint8_t*);
+extern int	readtrace(int, Batch*);
+extern void	mkprotograph(void);
+extern Proto*	findproto(char*);
+extern void	installfmts(void);
+
+int	LLVMFuzzerTestOneInput(const uint8_t*, size_t);
+
+typedef struct Filters Filters;
+struct Filters
+{
+	int	done;
+	Filter	**f;
+	int	n;
+};
+
+static int	nproto;
+static Filters	*rootfilters;
+static char	out[Outlen];
+
+static void
+setup(void)
+{
+	installfmts();
+	mkprotograph();
+	toflag = 1;	/* quiet compile */
+	for(nproto = 0; protos[nproto] != NULL; nproto++)
+		;
+	rootfilters = calloc(nproto, sizeof(Filters));
+	if(rootfilters == NULL)
+		sysfatal("fuzz: %r");
+}
+
+/*
+ *  so an input runs the same whatever came before it: the state
+ *  modules keep across packets, what udp has learned of rtp ports,
+ *  sniff's flows and the filter caches, is cleared.
+ */
+static void
+reset(void)
+{
+	udpreset();
+	sniffreset();
+	dumpreset();
+	memoreset();
+}
+
+/*
+ *  protocols reachable from pr, through the muxes
+ */
+static int
+reach(Proto *pr, Proto **seen, int n)
+{
+	Mux *m;
+	int i;
+
+	for(i = 0; i < n; i++)
+		if(seen[i] == pr)
+			return n;
+	if(n == Maxproto)
+		sysfatal("fuzz: too many protocols");
+	seen[n++] = pr;
+	for(m = pr->mux; m != NULL && m->name != NULL; m++)
+		if(m->pr != NULL)
+			n = reach(m->pr, seen, n);
+	return n;
+}
+
+static Filter*
+word(char *s)
+{
+	Filter *f;
+
+	f = newfilter();
+	f->op = WORD;
+	f->s = s;
+	return f;
+}
+
+/*
+ *  a value of a field's type, for a compare
+ */
+static char*
+anyval(int ftype)
+{
+	switch(ftype){
+	case Fether:
+		return "000000000000";
+	case Fv4ip:
+		return "0.0.0.0";
+	case Fv6ip:
+		return "::";
+	case Fba:
+		return "00000000000000000000000000000000";
+	}
+	return "0";
+}
+
+/*
+ *  a filter for each protocol reachable from pr that gets as far as
+ *  running its filter: a compare on its first field, or a test for
+ *  the first protocol it demuxes to.  an OR of them all wouldn't do,
+ *  as optimize folds the protocols into their parents' mux tests and
+ *  an OR stops at the first that's true.  dump and addproto's
+ *  stand-ins for it are left out.
+ */
+static void
+mkfilters(Filters *fs, Proto *pr)
+{
+	Proto *seen[Maxproto], *p;
+	Filter *f, *cmp;
+	int i, n;
+
+	n = reach(pr, seen, 0);
+	fs->f = calloc(n, sizeof(Filter*));
+	if(fs->f == NULL)
+		sysfatal("fuzz: %r");
+	for(i = 0; i < n; i++){
+		p = seen[i];
+		if(p->filter == NULL || p->filter == dump.filter)
+			continue;
+		f = word(p->name);
+		if(p->field != NULL && p->field[0].name != NULL){
+			cmp = newfilter();
+			cmp->op = '=';
+			cmp->l = word(p->field[0].name);
+			cmp->r = word(anyval(p->field[0].ftype));
+			f->l = cmp;
+		} else if(p->mux != NULL && p->mux[0].name != NULL)
+			f->l = word(p->mux[0].name);
+		fs->f[fs->n++] = compile(f);
+	}
+	fs->done = 1;
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	Filters *fs;
+	uint8_t *p;
+	int i, j, n;
+
+	if(nproto == 0)
+		setup();
+	if(size < 1)
+		return 0;
+	i = data[0] % nproto;
+	root = protos[i];
+	fs = &rootfilters[i];
+	if(!fs->done)
+		mkfilters(fs, root);
+
+	n = size-1;
+	p = malloc(n > 0 ? n : 1);
+	if(p == NULL)
+		sysfatal("fuzz: %r");
+	memmove(p, data+1, n);
+	reset();
+	for(j = 0; j < fs->n; j++)
+		filterpkt(fs->f[j], p, p+n, root, 1);
+	seprintpkt(out, out+sizeof out-1, p, p+n);
+	free(p);
+	return 0;
+}
+
+#ifndef LIBFUZZER
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: fuzz [file...]\n       fuzz -c dir [-h first-header] trace...\n");
+	exit(1);
+}
+
+static void
+runfd(int fd)
+{
+	static uint8_t in[1+Maxin];
+	int n, m;
+
+	for(n = 0; n < sizeof in; n += m){
+		m = read(fd, in+n, sizeof in - n);
+		if(m < 0)
+			sysfatal("fuzz: read: %r");
+		if(m == 0)
+			break;
+	}
+	LLVMFuzzerTestOneInput(in, n);
+}
+
+/*
+ *  each packet of the trace as a seed, behind the root's byte
+ */
+static void
+seeds(char *dir, char *trace, Proto *pr)
+{
+	uint8_t in[1+Pktlen];
+	char name[1024];
+	char *base;
+	Batch b;
+	int fd, ofd, i, n, r;
+
+	for(r = 0; protos[r] != NULL; r++)
+		if(protos[r] == pr)
+			break;
+	if(protos[r] == NULL)
+		sysfatal("%s can't be a root", pr->name);
+	base = strrchr(trace, '/');
+	base = base != NULL ? base+1 : trace;
+	fd = open(trace, O_RDONLY);
+	if(fd < 0)
+		sysfatal("can't open %s: %r", trace);
+	starttime = 0;
+	for(n = 0; n < Nseed && readtrace(fd, &b) > 0; batchfree(&b))
+		for(i = 0; i < b.n && n < Nseed; i++, n++){
+			in[0] = r;
+			memmove(in+1, b.pkt[i].ps, b.pkt[i].pe - b.pkt[i].ps);
+			snprintf(name, sizeof name, "%s/%s.%d", dir, base, n);
+			ofd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+			if(ofd < 0)
+				sysfatal("can't create %s: %r", name);
+			if(write(ofd, in, 1 + b.pkt[i].pe - b.pkt[i].ps) < 0)
+				sysfatal("writing %s: %r", name);
+			close(ofd);
+		}
+	close(fd);
+}
+
+int
+main(int argc, char **argv)
+{
+	Proto *pr;
+	char *dir;
+	int c, fd;
+
+	setup();
+	dir = NULL;
+	pr = &ether;
+	while((c = getopt(argc, argv, "c:h:")) != -1){
+		switch(c){
+		case 'c':
+			dir = optarg;
+			break;
+		case 'h':
+			pr = findproto(optarg);
+			if(pr == NULL)
+				sysfatal("unknown protocol: %s", optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if(dir != NULL){
+		if(optind == argc)
+			usage();
+		for(; optind < argc; optind++)
+			seeds(dir, argv[optind], pr);
+		return 0;
+	}
+
+	if(optind == argc){
+#ifdef __AFL_LOOP
+		while(__AFL_LOOP(1000))
+#endif
+			runfd(0);
+		return 0;
+	}
+	for(; optind < argc; optind++){
+		fd = open(argv[optind], O_RDONLY);
+		if(fd < 0)
+			sysfatal("can't open %s: %r", argv[optind]);
+		runfd(fd);
+		close(fd);
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,452 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  gentrace [-n npkt] [-s seed] kind
+ *
+ *  write a synthetic trace in snoopy's -t format to stdout, for the
+ *  benchmarks in bench.sh.  the same seed gives the same trace.
+ *  kinds:
+ *	tcp	ether/ip/tcp, a few hundred conversations
+ *	dns	ether/ip/udp/dns queries and answers
+ *	ip6	ether/ip6 with hop-by-hop, destination and fragment
+ *		headers in front of udp
+ *	gre	ether/ip/gre with a key around ip/udp
+ *	aoe	ether/aoe/aoeata reads and writes
+ *	dhcp	ether/ip/udp/bootp/dhcp discovers and requests
+ *
+ *  uses nothing but libc, so it builds on the host too.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define nelem(x)	(sizeof(x)/sizeof((x)[0]))
+
+enum
+{
+	Maxpkt=	2048,
+
+	Etherlen=	14,
+	Ip4len=	20,
+	Ip6len=	40,
+	Udplen=	8,
+	Tcplen=	20,
+};
+
+typedef struct Gen Gen;
+struct Gen
+{
+	char	*name;
+	int	(*gen)(uint8_t*);
+};
+
+static uint64_t	seed = 1;
+static int64_t	now = 1000000000LL;
+
+static uint32_t
+rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed >> 16;
+}
+
+static int
+nrand(int n)
+{
+	return rnd() % n;
+}
+
+static void
+put16(uint8_t *p, uint32_t v)
+{
+	p[0] = v>>8;
+	p[1] = v;
+}
+
+static void
+put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v>>24;
+	p[1] = v>>16;
+	p[2] = v>>8;
+	p[3] = v;
+}
+
+static void
+fill(uint8_t *p, int n)
+{
+	while(n-- > 0)
+		*p++ = rnd();
+}
+
+static int
+ether(uint8_t *p, int type)
+{
+	static uint8_t mac[2][6] = {
+		{ 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 },
+		{ 0x00, 0x66, 0x77, 0x88, 0x99, 0xaa },
+	};
+	int d;
+
+	d = nrand(2);
+	memmove(p, mac[d], 6);
+	memmove(p+6, mac[!d], 6);
+	put16(p+12, type);
+	return Etherlen;
+}
+
+static uint16_t
+cksum(uint8_t *p, int n)
+{
+	uint32_t s;
+
+	for(s = 0; n > 1; n -= 2, p += 2)
+		s += p[0]<<8 | p[1];
+	if(n)
+		s += p[0]<<8;
+	while(s >> 16)
+		s = (s & 0xffff) + (s >> 16);
+	return ~s;
+}
+
+/*
+ *  an ip header in front of len bytes of proto, from one of
+ *  naddr hosts on 10.0/16 to another
+ */
+static int
+ip4(uint8_t *p, int proto, int len, int naddr)
+{
+	p[0] = 0x45;
+	p[1] = 0;
+	put16(p+2, Ip4len+len);
+	put16(p+4, rnd());
+	put16(p+6, 0x4000);
+	p[8] = 64;
+	p[9] = proto;
+	put16(p+10, 0);
+	put32(p+12, 0x0a000000 | nrand(naddr));
+	put32(p+16, 0x0a000000 | nrand(naddr));
+	put16(p+10, cksum(p, Ip4len));
+	return Ip4len;
+}
+
+static int
+udp(uint8_t *p, int sport, int dport, int len)
+{
+	put16(p, sport);
+	put16(p+2, dport);
+	put16(p+4, Udplen+len);
+	put16(p+6, 0);
+	return Udplen;
+}
+
+static int
+gentcp(uint8_t *p)
+{
+	static int flags[] = { 0x02, 0x12, 0x10, 0x18, 0x18, 0x18, 0x11, 0x04 };
+	uint8_t *ip, *t;
+	int n;
+
+	n = nrand(4) ? nrand(1400) : 0;
+	ip = p + ether(p, 0x0800);
+	t = ip + ip4(ip, 6, Tcplen+n, 256);
+	put16(t, 1024 + nrand(300));
+	put16(t+2, nrand(4) ? 443 : 80);
+	put32(t+4, rnd());
+	put32(t+8, rnd());
+	t[12] = (Tcplen/4)<<4;
+	t[13] = flags[nrand(nelem(flags))];
+	put16(t+14, 65535);
+	put16(t+16, 0);
+	put16(t+18, 0);
+	fill(t+Tcplen, n);
+	return t + Tcplen + n - p;
+}
+
+/*
+ *  a name of 2 to 4 labels, returns its length
+ */
+static int
+dnsname(uint8_t *p)
+{
+	static char *label[] = { "www", "mail", "example", "plan9", "bell-labs", "akaros", "cs", "berkeley" };
+	uint8_t *s;
+	char *l;
+	int i, n;
+
+	s = p;
+	n = 2 + nrand(3);
+	for(i = 0; i < n; i++){
+		l = label[nrand(nelem(label))];
+		*p++ = strlen(l);
+		memmove(p, l, strlen(l));
+		p += strlen(l);
+	}
+	memmove(p, "\003com", 4);
+	p += 4;
+	*p++ = 0;
+	return p - s;
+}
+
+static int
+gendns(uint8_t *p)
+{
+	uint8_t *ip, *u, *d, *q;
+	int resp, n;
+
+	resp = nrand(2);
+	d = p + Etherlen + Ip4len + Udplen;
+	put16(d, rnd());
+	put16(d+2, resp ? 0x8180 : 0x0100);
+	put16(d+4, 1);
+	put16(d+6, resp);
+	put16(d+8, 0);
+	put16(d+10, 0);
+	q = d + 12;
+	q += dnsname(q);
+	put16(q, nrand(3) ? 1 : 28);
+	put16(q+2, 1);
+	q += 4;
+	if(resp){
+		put16(q, 0xc00c);
+		put16(q+2, 1);
+		put16(q+4, 1);
+		put32(q+6, 300);
+		put16(q+10, 4);
+		put32(q+12, rnd());
+		q += 16;
+	}
+	n = q - d;
+
+	ip = p + ether(p, 0x0800);
+	u = ip + ip4(ip, 17, Udplen+n, 64);
+	if(resp)
+		udp(u, 53, 1024 + nrand(60000), n);
+	else
+		udp(u, 1024 + nrand(60000), 53, n);
+	return d + n - p;
+}
+
+static int
+genip6(uint8_t *p)
+{
+	uint8_t *h, *x;
+	int n, frag;
+
+	n = nrand(1200);
+	frag = nrand(2);
+	h = p + ether(p, 0x86dd);
+	put32(h, 0x60000000);
+	h[7] = 64;
+	put32(h+8, 0x20010db8);
+	memset(h+12, 0, 11);
+	h[23] = nrand(64);
+	put32(h+24, 0x20010db8);
+	memset(h+28, 0, 11);
+	h[39] = nrand(64);
+
+	/* hop-by-hop and destination options, 8 bytes of padding apiece */
+	h[6] = 0;
+	x = h + Ip6len;
+	x[0] = 60;
+	x[1] = 0;
+	x[2] = 1;
+	x[3] = 4;
+	memset(x+4, 0, 4);
+	x += 8;
+	x[0] = frag ? 44 : 17;
+	x[1] = 0;
+	x[2] = 1;
+	x[3] = 4;
+	memset(x+4, 0, 4);
+	x += 8;
+	if(frag){
+		/* an atomic fragment */
+		x[0] = 17;
+		x[1] = 0;
+		put16(x+2, 0);
+		put32(x+4, rnd());
+		x += 8;
+	}
+	x += udp(x, 1024 + nrand(60000), 5000 + nrand(10), n);
+	fill(x, n);
+	put16(h+4, x + n - (h + Ip6len));
+	return x + n - p;
+}
+
+static int
+gengre(uint8_t *p)
+{
+	uint8_t *ip, *g, *in, *u;
+	int n;
+
+	n = nrand(1000);
+	ip = p + ether(p, 0x0800);
+	g = ip + ip4(ip, 47, 8 + Ip4len + Udplen + n, 4);
+	put16(g, 0x2000);
+	put16(g+2, 0x0800);
+	put32(g+4, nrand(16));
+	in = g + 8;
+	u = in + ip4(in, 17, Udplen + n, 256);
+	u += udp(u, 1024 + nrand(60000), 4789, n);
+	fill(u, n);
+	return u + n - p;
+}
+
+static int
+genaoe(uint8_t *p)
+{
+	uint8_t *a, *ata;
+	int write, n;
+
+	write = nrand(2);
+	a = p + ether(p, 0x88a2);
+	a[0] = 0x10 | (nrand(2) ? 0x8 : 0);	/* version 1, maybe a response */
+	a[1] = 0;
+	put16(a+2, nrand(4));
+	a[4] = nrand(8);
+	a[5] = 0;
+	put32(a+6, rnd());
+	ata = a + 10;
+	ata[0] = write ? 0x41 : 0x40;		/* extended, write */
+	ata[1] = 0;
+	ata[2] = 1 + nrand(2);
+	ata[3] = write ? 0x34 : 0x24;		/* write/read sectors ext */
+	put32(ata+4, rnd());
+	put16(ata+8, 0);
+	n = 0;
+	if(write){
+		n = 512*ata[2];
+		fill(ata+12, n);
+	}
+	return ata + 12 + n - p;
+}
+
+static int
+gendhcp(uint8_t *p)
+{
+	uint8_t *ip, *u, *b, *o;
+	int n;
+
+	b = p + Etherlen + Ip4len + Udplen;
+	memset(b, 0, 236);
+	b[0] = 1;
+	b[1] = 1;
+	b[2] = 6;
+	put32(b+4, rnd());
+	put16(b+10, 0x8000);
+	b[28] = 0x00;
+	b[29] = 0x16;
+	put32(b+30, rnd());
+	o = b + 236;
+	put32(o, 0x63825363);
+	o += 4;
+	*o++ = 53;		/* message type */
+	*o++ = 1;
+	*o++ = nrand(2) ? 1 : 3;
+	*o++ = 61;		/* client id */
+	*o++ = 7;
+	*o++ = 1;
+	memmove(o, b+28, 6);
+	o += 6;
+	*o++ = 50;		/* requested address */
+	*o++ = 4;
+	put32(o, 0x0a000000 | nrand(256));
+	o += 4;
+	*o++ = 12;		/* host name */
+	*o++ = 5;
+	memmove(o, "plan9", 5);
+	o += 5;
+	*o++ = 55;		/* parameters */
+	*o++ = 4;
+	*o++ = 1;
+	*o++ = 3;
+	*o++ = 6;
+	*o++ = 15;
+	*o++ = 255;
+	n = o - b;
+
+	ip = p + ether(p, 0x0800);
+	u = ip + ip4(ip, 17, Udplen+n, 1);
+	udp(u, 68, 67, n);
+	return b + n - p;
+}
+
+static Gen gens[] = {
+	{ "tcp",	gentcp, },
+	{ "dns",	gendns, },
+	{ "ip6",	genip6, },
+	{ "gre",	gengre, },
+	{ "aoe",	genaoe, },
+	{ "dhcp",	gendhcp, },
+	{ 0 }
+};
+
+static void
+usage(void)
+{
+	Gen *g;
+
+	fprintf(stderr, "usage: gentrace [-n npkt] [-s seed] kind\nkinds:");
+	for(g = gens; g->name != NULL; g++)
+		fprintf(stderr, " %s", g->name);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	uint8_t buf[10+Maxpkt];
+	Gen *g;
+	long i, npkt;
+	int c, n;
+
+	npkt = 100000;
+	while((c = getopt(argc, argv, "n:s:")) != -1){
+		switch(c){
+		case 'n':
+			npkt = atol(optarg);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			if(seed == 0)
+				seed = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if(optind != argc-1)
+		usage();
+	for(g = gens; g->name != NULL; g++)
+		if(strcmp(g->name, argv[optind]) == 0)
+			break;
+	if(g->name == NULL)
+		usage();
+
+	for(i = 0; i < npkt; i++){
+		memset(buf, 0, sizeof buf);
+		n = (*g->gen)(buf+10);
+		now += 1000 + nrand(100000);
+		put16(buf, n);
+		put32(buf+2, now>>32);
+		put32(buf+6, now);
+		if(fwrite(buf, 1, 10+n, stdout) != 10+n){
+			perror("gentrace");
+			exit(1);
+		}
+	}
+	return 0;
+}
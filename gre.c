@@ -168,7 +168,7 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Oproto:
-		return h.proto == f->ulv;
+		return fmatch(f, h.proto);
 	}
 	return 0;
 }
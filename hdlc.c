@@ -102,7 +102,7 @@ p_filter(Filter *f, Msg *m)
 	switch(f->subop){
 	case Ot:
 		t = (m->ps[0]<<8)|m->ps[1];
-		if(t != f->ulv)
+		if(!fmatch(f, t))
 			return 0;
 		break;
 	}
@@ -0,0 +1,189 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  -H n: instead of printing the packets that match, count them in a
+ *  tree of the protocol paths they take, ether/ip/udp/rtp say, with
+ *  packets and bytes for each.  the headers are decoded by their
+ *  modules' seprint, without formatting.  a packet's bytes count at
+ *  every level of its path.  the tree is printed every n seconds of
+ *  packet time, unless n is 0, and at the end.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "ip.h"
+#include "dat.h"
+#include "protos.h"
+
+int Hflag;
+int Hival;
+
+enum
+{
+	Sec=	1000000000LL,
+	Nnode=	4096,
+	Maxdepth=	32,
+	Namelen=	64,
+	Linelen=	Namelen+64,	/* a name, and the numbers at their widest */
+};
+
+typedef struct Node Node;
+struct Node
+{
+	Proto	*pr;
+	uint64_t	pkts;
+	uint64_t	bytes;
+	Node	*kid;
+	Node	*next;
+};
+
+extern Proto *root;
+
+static Node	top;
+static Node	*nodes;
+static int	nnode;
+static int64_t	nextprint;
+
+/*
+ *  up's child for pr, made if need be
+ */
+static Node*
+child(Node *up, Proto *pr)
+{
+	Node *n;
+
+	for(n = up->kid; n != NULL; n = n->next)
+		if(n->pr == pr)
+			return n;
+	if(nodes == NULL){
+		nodes = calloc(Nnode, sizeof(Node));
+		if(nodes == NULL)
+			sysfatal("hier: %r");
+	}
+	if(nnode == Nnode)
+		return NULL;
+	n = &nodes[nnode++];
+	n->pr = pr;
+	n->next = up->kid;
+	up->kid = n;
+	return n;
+}
+
+/*
+ *  count a packet under its path
+ */
+void
+hieradd(Pkt *p)
+{
+	uint64_t len;
+	int64_t ival;
+	char buf[1];
+	Node *n, *up;
+	Msg m;
+	int d;
+
+	if(Hival > 0 && p->time >= nextprint){
+		if(nextprint != 0)
+			hierprint();
+		ival = (int64_t)Hival*Sec;
+		nextprint = (p->time/ival + 1) * ival;
+	}
+
+	len = p->pe - p->ps;
+	top.pkts++;
+	top.bytes += len;
+	m.ps = p->ps;
+	m.pe = p->pe;
+	m.pr = root;
+	m.p = m.e = buf;
+	m.needroot = 0;
+	up = &top;
+	for(d = 0; d < Maxdepth && m.pr != NULL && m.ps < m.pe; d++){
+		n = child(up, m.pr);
+		if(n == NULL)
+			break;
+		n->pkts++;
+		n->bytes += len;
+		if(m.pr == &dump || (*m.pr->seprint)(&m) < 0)
+			break;
+		up = n;
+	}
+}
+
+static int
+nodecmp(const void *a, const void *b)
+{
+	Node *x, *y;
+
+	x = *(Node**)a;
+	y = *(Node**)b;
+	if(x->pkts != y->pkts)
+		return x->pkts > y->pkts ? -1 : 1;
+	return strcmp(x->pr->name, y->pr->name);
+}
+
+/*
+ *  up's children, busiest first
+ */
+static char*
+seprintkids(char *p, char *e, Node *up, int depth)
+{
+	Node *n, **kid;
+	int i, nkid;
+	char name[Namelen];
+
+	nkid = 0;
+	for(n = up->kid; n != NULL; n = n->next)
+		nkid++;
+	if(nkid == 0)
+		return p;
+	kid = malloc(nkid*sizeof(Node*));
+	if(kid == NULL)
+		sysfatal("hier: %r");
+	i = 0;
+	for(n = up->kid; n != NULL; n = n->next)
+		kid[i++] = n;
+	qsort(kid, nkid, sizeof kid[0], nodecmp);
+	for(i = 0; i < nkid; i++){
+		n = kid[i];
+		snprintf(name, sizeof name, "%*s%s", 2*depth, "", n->pr->name);
+		p = seprint(p, e, "%-24s %12llu %6.2f%% %14llu %6.2f%%\n", name,
+			(unsigned long long)n->pkts, 100.0*n->pkts/top.pkts,
+			(unsigned long long)n->bytes, 100.0*n->bytes/top.bytes);
+		p = seprintkids(p, e, n, depth+1);
+	}
+	free(kid);
+	return p;
+}
+
+/*
+ *  in one write, so workers' trees don't interleave
+ */
+void
+hierprint(void)
+{
+	char *buf, *p, *e;
+	size_t n;
+
+	if(top.pkts == 0)
+		return;
+	n = (nnode+2)*Linelen;
+	buf = malloc(n);
+	if(buf == NULL)
+		sysfatal("hier: %r");
+	p = buf;
+	e = buf + n;
+	p = seprint(p, e, "%-24s %12s %7s %14s %7s pid %d\n", "protocol",
+		"packets", "", "bytes", "", getpid());
+	p = seprintkids(p, e, &top, 0);
+	if(p > e)	/* seprint says what it would have printed */
+		p = e;
+	write(1, buf, p - buf);
+	free(buf);
+}
@@ -0,0 +1,136 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  -E secs: estimate how many distinct sources, destinations and
+ *  flows the matching ip packets have, instead of printing them.
+ *  printed every secs of packet time, and then started over, unless
+ *  secs is 0, and at the end.
+ *
+ *  each is a hyperloglog of 2^Pbits one byte registers: the top Pbits
+ *  of a key's hash pick a register, which keeps the most leading
+ *  zeros, plus one, seen in the rest.  the estimate is good to about
+ *  1.04/sqrt(2^Pbits), under 1%.  a packet costs a hash and a compare
+ *  per kind.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "ip.h"
+#include "dat.h"
+
+int Eflag;
+int Eival;
+
+enum
+{
+	Sec=	1000000000LL,
+	Pbits=	14,
+	Nreg=	1<<Pbits,
+	Keylen=	2*IPaddrlen+5,
+
+	Ksrc=	0,
+	Kdst,
+	Kflow,
+	Nkind,
+};
+
+extern Proto *root;
+extern int64_t starttime;
+
+static uint8_t	reg[Nkind][Nreg];
+static uint64_t	npkt;
+static int64_t	nextprint, from;
+
+static void
+hlladd(uint8_t *r, uint8_t *k, int n)
+{
+	uint64_t h;
+	int i, z;
+
+	h = hash64(k, n);
+	i = h >> (64-Pbits);
+	z = __builtin_clzll(h<<Pbits | 1ULL<<(Pbits-1)) + 1;
+	if(z > r[i])
+		r[i] = z;
+}
+
+static uint64_t
+hllcount(uint8_t *r)
+{
+	double m, sum, e;
+	int i, zeros;
+
+	m = Nreg;
+	sum = 0;
+	zeros = 0;
+	for(i = 0; i < Nreg; i++){
+		sum += ldexp(1.0, -r[i]);
+		if(r[i] == 0)
+			zeros++;
+	}
+	e = 0.7213/(1 + 1.079/m) * m*m / sum;
+	/* small counts are better off counting empty registers */
+	if(e <= 2.5*m && zeros > 0)
+		e = m * log(m/zeros);
+	return e + 0.5;
+}
+
+/*
+ *  count a matching packet's source, destination and flow
+ */
+void
+estadd(Pkt *p)
+{
+	uint8_t k[Keylen];
+	int64_t ival;
+	Flow fl;
+
+	if(Eival > 0 && p->time >= nextprint){
+		if(nextprint != 0){
+			estprint();
+			memset(reg, 0, sizeof reg);
+			npkt = 0;
+		}
+		ival = (int64_t)Eival*Sec;
+		from = starttime + (p->time - starttime)/ival * ival;
+		nextprint = from + ival;
+	}
+	if(!flowkey(&fl, p->ps, p->pe, root))
+		return;
+	npkt++;
+	hlladd(reg[Ksrc], fl.src, IPaddrlen);
+	hlladd(reg[Kdst], fl.dst, IPaddrlen);
+	memmove(k, fl.src, IPaddrlen);
+	memmove(k+IPaddrlen, fl.dst, IPaddrlen);
+	hnputs(k+2*IPaddrlen, fl.sport);
+	hnputs(k+2*IPaddrlen+2, fl.dport);
+	k[2*IPaddrlen+4] = fl.proto;
+	hlladd(reg[Kflow], k, Keylen);
+}
+
+void
+estprint(void)
+{
+	char buf[256], *p, *e;
+
+	if(npkt == 0)
+		return;
+	p = buf;
+	e = buf + sizeof buf;
+	if(Eival > 0)
+		p = seprint(p, e, "%lld s: ", (long long)((from - starttime)/Sec));
+	p = seprint(p, e, "%llu ip packets, ~%llu sources, ~%llu destinations, ~%llu flows, pid %d\n",
+		(unsigned long long)npkt,
+		(unsigned long long)hllcount(reg[Ksrc]),
+		(unsigned long long)hllcount(reg[Kdst]),
+		(unsigned long long)hllcount(reg[Kflow]),
+		getpid());
+	write(1, buf, p - buf);
+}
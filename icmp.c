@@ -105,7 +105,7 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Ot:
-		if(h->type == f->ulv)
+		if(fmatch(f, h->type))
 			return 1;
 		break;
 	case Op:
@@ -122,6 +122,23 @@ p_filter(Filter *f, Msg *m)
 	return 0;
 }
 
+/*
+ *  the type; the next protocol depends on it
+ */
+static int
+p_lower(Filter *f, Vop *v)
+{
+	if(f->subop != Ot)
+		return 0;
+	v->minlen = ICMPLEN;
+	v->hlen = ICMPLEN;
+	v->noff = 1;
+	v->off[0] = offsetof(Hdr, type);
+	v->width = 1;
+	v->val = f->ulv;
+	return 1;
+}
+
 static int
 p_seprint(Msg *m)
 {
@@ -202,4 +219,5 @@ Proto icmp =
 	"%lu",
 	p_fields,
 	defaultframer,
+	p_lower,
 };
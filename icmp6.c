@@ -172,7 +172,7 @@ p_filter(Filter *f, Msg *m)
 	switch(f->subop){
 
 	case Ot:
-		if(h->type == f->ulv)
+		if(fmatch(f, h->type))
 			return 1;
 		break;
 	case Op:
@@ -87,11 +87,11 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Os:
-		return NetS(h->sport) == f->ulv;
+		return fmatch(f, NetS(h->sport));
 	case Od:
-		return NetS(h->dport) == f->ulv;
+		return fmatch(f, NetS(h->dport));
 	case Osd:
-		return NetS(h->sport) == f->ulv || NetS(h->dport) == f->ulv;
+		return fmatch(f, NetS(h->sport)) || fmatch(f, NetS(h->dport));
 	}
 	return 0;
 }
@@ -133,6 +133,8 @@ p_seprint(Msg *m)
 	dport = NetS(h->dport);
 	sport = NetS(h->sport);
 	demux(p_mux, sport, dport, m, &dump);
+	if(m->pr == &dump)
+		m->pr = sniff(&il, sport, dport, m->ps, m->pe);
 
 	m->p = seprint(m->p, m->e, "s=%d d=%d t=%s id=%lu ack=%lu spec=%d ck=%4.4x ln=%d",
 			sport, dport, pkttype(h->type),
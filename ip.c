@@ -185,17 +185,48 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Os:
-		return NetL(h->src) == f->ulv;
+		return fmatch(f, NetL(h->src));
 	case Od:
-		return NetL(h->dst) == f->ulv;
+		return fmatch(f, NetL(h->dst));
 	case Osd:
-		return NetL(h->src) == f->ulv || NetL(h->dst) == f->ulv;
+		return fmatch(f, NetL(h->src)) || fmatch(f, NetL(h->dst));
 	case Ot:
-		return h->proto == f->ulv;
+		return fmatch(f, h->proto);
 	}
 	return 0;
 }
 
+static int
+p_lower(Filter *f, Vop *v)
+{
+	v->minlen = IPHDR;
+	v->hoff = offsetof(Hdr, vihl);
+	v->hmask = 0xf;
+
+	switch(f->subop){
+	case Os:
+		v->off[v->noff++] = offsetof(Hdr, src);
+		break;
+	case Od:
+		v->off[v->noff++] = offsetof(Hdr, dst);
+		break;
+	case Osd:
+		v->off[v->noff++] = offsetof(Hdr, src);
+		v->off[v->noff++] = offsetof(Hdr, dst);
+		break;
+	case Ot:
+		v->off[v->noff++] = offsetof(Hdr, proto);
+		v->width = 1;
+		v->val = f->ulv;
+		return 1;
+	default:
+		return 0;
+	}
+	v->width = 4;
+	v->val = f->ulv;
+	return 1;
+}
+
 static int
 p_seprint(Msg *m)
 {
@@ -248,4 +279,5 @@ Proto ip =
 	"%lu",
 	p_fields,
 	defaultframer,
+	p_lower,
 };
@@ -213,14 +213,13 @@ p_filter(Filter *f, Msg *m)
 		m->ps += hlen;
 	switch(f->subop){
 	case Os:
-		return memcmp(h->src, f->a, IPaddrlen) == 0;
+		return fmatch6(f, h->src);
 	case Od:
-		return memcmp(h->dst, f->a, IPaddrlen) == 0;
+		return fmatch6(f, h->dst);
 	case Osd:
-		return memcmp(h->src, f->a, IPaddrlen) == 0 ||
-			memcmp(h->dst, f->a, IPaddrlen) == 0;
+		return fmatch6(f, h->src) || fmatch6(f, h->dst);
 	case Ot:
-		return h->proto == f->ulv;
+		return fmatch(f, h->proto);
 	}
 	return 0;
 }
@@ -0,0 +1,135 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  a multibit trie of address prefixes, for sets of ip and ip6
+ *  addresses.  the first level is indexed by the top 16 bits of the
+ *  address and each level below by the next 8, so a v4 lookup takes
+ *  at most 3 memory references and a v6 one at most 15.  prefixes
+ *  that end inside a level are expanded to cover all the entries
+ *  they span.  we only need to know whether some prefix covers an
+ *  address, so an entry is either empty, covered, or a child level.
+ */
+#include "ip.h"
+#include "dat.h"
+
+enum
+{
+	Lnone=	0,
+	Lmatch=	1,	/* anything else is a child level + Lkid */
+	Lkid=	2,
+
+	Ltop=	1<<16,	/* entries in the first level */
+	Lnext=	1<<8,	/* entries in the others */
+};
+
+struct Lpm
+{
+	uint32_t	*top;
+	uint32_t	*kid;	/* child levels, Lnext entries apiece */
+	int	nkid;
+	int	akid;
+};
+
+Lpm*
+mklpm(void)
+{
+	Lpm *l;
+
+	l = calloc(1, sizeof *l);
+	if(l == NULL)
+		sysfatal("mklpm: %r");
+	/* every v4 lookup starts here */
+	l->top = bigalloc(Ltop*sizeof(uint32_t));
+	return l;
+}
+
+static uint32_t
+newkid(Lpm *l)
+{
+	if(l->nkid == l->akid){
+		l->akid = l->akid ? 2*l->akid : 64;
+		l->kid = realloc(l->kid, l->akid*Lnext*sizeof(uint32_t));
+		if(l->kid == NULL)
+			sysfatal("lpmadd: %r");
+	}
+	memset(l->kid + l->nkid*Lnext, 0, Lnext*sizeof(uint32_t));
+	return Lkid + l->nkid++;
+}
+
+/*
+ *  add prefix a/plen, a being alen bytes long
+ */
+void
+lpmadd(Lpm *l, uint8_t *a, int alen, int plen)
+{
+	uint32_t *e, k;
+	int i, n, bits, idx, span, lev;
+
+	if(plen > alen*8)
+		plen = alen*8;
+	lev = -1;
+	idx = (a[0]<<8) | a[1];
+	bits = 16;
+	for(i = 2;; i++){
+		e = lev < 0 ? l->top : l->kid + lev*Lnext;
+		if(plen <= bits){
+			/* ends in this level, cover the entries it spans */
+			span = 1 << (bits-plen);
+			idx &= ~(span-1);
+			for(n = 0; n < span; n++)
+				e[idx+n] = Lmatch;
+			return;
+		}
+		k = e[idx];
+		if(k == Lmatch)
+			return;		/* already covered */
+		if(k == Lnone){
+			k = newkid(l);
+			/* newkid may have moved the child levels */
+			e = lev < 0 ? l->top : l->kid + lev*Lnext;
+			e[idx] = k;
+		}
+		if(i >= alen)
+			return;
+		lev = k - Lkid;
+		idx = a[i];
+		plen -= bits;
+		bits = 8;
+	}
+}
+
+/*
+ *  is a covered by some prefix?
+ */
+int
+lpmmatch(Lpm *l, uint8_t *a, int alen)
+{
+	uint32_t k;
+	int i;
+
+	k = l->top[(a[0]<<8) | a[1]];
+	for(i = 2; k >= Lkid && i < alen; i++)
+		k = l->kid[(k-Lkid)*Lnext + a[i]];
+	return k == Lmatch;
+}
+
+int
+lpmmatch4(Lpm *l, uint32_t v)
+{
+	uint32_t k;
+
+	k = l->top[v>>16];
+	if(k < Lkid)
+		return k;
+	k = l->kid[(k-Lkid)*Lnext + ((v>>8) & 0xff)];
+	if(k < Lkid)
+		return k;
+	return l->kid[(k-Lkid)*Lnext + (v & 0xff)] == Lmatch;
+}
@@ -34,6 +34,10 @@ int Mflag;
 int sflag;
 int tiflag;
 int toflag;
+int wflag;
+int Uflag;
+char *nflag;
+char *mflag;
 char *argv0;
 char *buf;
 
@@ -42,31 +46,66 @@ char *oneblock = "oneblock";
 
 enum
 {
-	Pktlen=	64*1024,
 	Blen=	16*1024,
 	Pcaphdrlen = 16,
 	Fakeethhdrlen = 14,
+	Nout=	32,
 };
 
+/*
+ *  a named filter from -F and the file its packets go to
+ */
+typedef struct Out Out;
+struct Out
+{
+	char	*name;
+	Filter	*f;
+	int	fd;
+};
+Out outs[Nout];
+int nouts;
+
 Filter *filter;
 Proto *root;
 int64_t starttime, pkttime;
 int pcap;
 
+static uint64_t	lastbatch;	/* for -P, when the last batch was done */
+
 int	filterpkt(Filter *f, uint8_t *ps, uint8_t *pe, Proto *pr, int);
-void	printpkt(char *p, char *e, uint8_t *ps, uint8_t *pe);
+char*	seprintpkt(char *p, char *e, uint8_t *ps, uint8_t *pe);
+void	printpkt(char *p, char *e, uint8_t *ps, uint8_t *pe, int fd);
 void	mkprotograph(void);
 Proto*	findproto(char *name);
 Filter*	compile(Filter *f);
 void	printfilter(Filter *f, char *tag);
 void	printhelp(char*);
-void	tracepkt(uint8_t*, int);
-void	pcaphdr(void);
+void	tracepkt(Pkt*, int);
+void	pcaphdr(int);
+void	writeall(int, char*, int);
+void	writepkt(int, char*, int, Pbuf*);
+void	openouts(void);
+int	readtrace(int, Batch*);
+void	dobatch(Batch*, char*, char*);
+void	kernelfilter(int);
+void	installfmts(void);
 
 void
 printusage(void)
 {
-	fprintf(stderr, "usage: %s [-CDdpst] [-N n] [-f filter] [-h first-header] path\n", argv0);
+	fprintf(stderr, "usage: %s [-CDdpstUGP] [-N n] [-S n] [-K n] [-R pps] [-H secs] [-T n[:secs]] [-E secs] [-L secs] [-Q secs] [-f filter] [-F name:filter]... [-h first-header] path\n", argv0);
+#ifdef __linux__
+	fprintf(stderr, "  path packet!ifname captures from a linux interface,\n");
+	fprintf(stderr, "  -w n workers share it by -m hash (the default) or -m cpu\n");
+	fprintf(stderr, "  -U reads and writes through an io_uring\n");
+	fprintf(stderr, "  -G uses reserved hugepages, -n node|nic binds to a NUMA node\n");
+	fprintf(stderr, "  -P times each stage and protocol, printed at exit or on SIGUSR1\n");
+#endif
+	fprintf(stderr, "  -H counts the protocol paths taken instead, printed every secs and at exit\n");
+	fprintf(stderr, "  -T lists the top n addresses, ports and flows instead, the same way\n");
+	fprintf(stderr, "  -E estimates the distinct addresses and flows instead, the same way\n");
+	fprintf(stderr, "  -L times tcp round trips instead, the same way\n");
+	fprintf(stderr, "  -Q reports rtp stream loss and jitter instead, the same way\n");
 	fprintf(stderr, "  for protocol help: %s -? [proto]\n", argv0);
 }
 
@@ -85,11 +124,26 @@ static struct option long_options[] = {
 	{"p",         no_argument,       0, 'p'},
 	{"t",         no_argument,       0, 't'},
 	{"s",          no_argument,       0, 's'},
+	{"U",          no_argument,       0, 'U'},
+	{"G",          no_argument,       0, 'G'},
+	{"P",          no_argument,       0, 'P'},
 
 	{"proto",          required_argument,       0, 'h'},
 	{"M",          required_argument,       0, 'M'},
 	{"N",          required_argument,       0, 'N'},
 	{"f",          required_argument,       0, 'f'},
+	{"F",          required_argument,       0, 'F'},
+	{"S",          required_argument,       0, 'S'},
+	{"K",          required_argument,       0, 'K'},
+	{"R",          required_argument,       0, 'R'},
+	{"w",          required_argument,       0, 'w'},
+	{"m",          required_argument,       0, 'm'},
+	{"n",          required_argument,       0, 'n'},
+	{"H",          required_argument,       0, 'H'},
+	{"T",          required_argument,       0, 'T'},
+	{"E",          required_argument,       0, 'E'},
+	{"L",          required_argument,       0, 'L'},
+	{"Q",          required_argument,       0, 'Q'},
 	{}
 };
 
@@ -124,6 +178,24 @@ static int printf_ipv4addr_info(const struct printf_info* info, size_t n, int *a
     return 1;
 }
 
+/* the printf verbs the protocol modules print with */
+void
+installfmts(void)
+{
+	if (register_printf_specifier('E', printf_ethaddr, printf_ethaddr_info))
+		printf("Failed to register 'E'\n");
+	/* Might have trouble with %I.  Not sure on the details. */
+	if (register_printf_specifier('I', printf_ipaddr, printf_ipaddr_info))
+		printf("Failed to register 'I'\n");
+	/* I think they wanted %V to be IPv4 */
+	if (register_printf_specifier('V', printf_ipv4addr, printf_ipv4addr_info))
+		printf("Failed to register 'V'\n");
+	if (register_printf_specifier('F', printf_fcall, printf_fcall_info))
+		printf("Failed to register 'F'\n");
+	if (register_printf_specifier('H', printf_hexdump, printf_hexdump_info))
+		printf("Failed to register 'H'\n");
+}
+
 /* We just need any ether, not necessarily ether0.  ifconfig currently attaches
  * just one NIC. */
 static const char *get_first_ether(void)
@@ -150,30 +222,19 @@ int
 main(int argc, char **argv)
 {
 	int option_index;
-	uint8_t *pkt;
 	char *buf, *p, *e;
 	const char *file;
-	int fd, cfd;
+	int fd, cfd, packet;
 	int n;
 	char c;
+	Batch b;
+	Pbuf *pb;
+	Filter *f;
 
 	argv0 = argv[0];
 
-	if (register_printf_specifier('E', printf_ethaddr, printf_ethaddr_info))
-		printf("Failed to register 'E'\n");
-	/* Might have trouble with %I.  Not sure on the details. */
-	if (register_printf_specifier('I', printf_ipaddr, printf_ipaddr_info))
-		printf("Failed to register 'I'\n");
-	/* I think they wanted %V to be IPv4 */
-	if (register_printf_specifier('V', printf_ipv4addr, printf_ipv4addr_info))
-		printf("Failed to register 'V'\n");
-	if (register_printf_specifier('F', printf_fcall, printf_fcall_info))
-		printf("Failed to register 'F'\n");
-	if (register_printf_specifier('H', printf_hexdump, printf_hexdump_info))
-		printf("Failed to register 'H'\n");
+	installfmts();
 
-	pkt = malloc(Pktlen + Pcaphdrlen + Fakeethhdrlen);
-	pkt += Pcaphdrlen + Fakeethhdrlen;
 	buf = malloc(Blen);
 	e = buf+Blen-1;
 
@@ -182,7 +243,7 @@ main(int argc, char **argv)
 
 	mkprotograph();
 
-	while ((c = getopt_long(argc, argv, "?CdDtsh:M:N:f:", long_options,
+	while ((c = getopt_long(argc, argv, "?CdDtsUGPh:M:N:f:F:S:K:R:w:m:n:H:T:E:L:Q:", long_options,
 	                        &option_index)) != -1) {
 		switch (c) {
 		case '?':
@@ -204,9 +265,75 @@ main(int argc, char **argv)
 		yyinit(p);
 		yyparse();
 		break;
+	case 'F':
+		if(nouts == Nout)
+			sysfatal("too many -F filters");
+		p = strchr(optarg, ':');
+		if(p == NULL)
+			sysfatal("-F wants name:filter");
+		*p++ = 0;
+		f = filter;
+		filter = NULL;
+		yyinit(p);
+		yyparse();
+		outs[nouts].name = optarg;
+		outs[nouts++].f = filter;
+		filter = f;
+		break;
+	case 'S':
+		Sflag = atoi(optarg);
+		break;
+	case 'K':
+		Kflag = atoi(optarg);
+		break;
+	case 'R':
+		Rflag = atoi(optarg);
+		break;
+	case 'w':
+		wflag = atoi(optarg);
+		break;
+	case 'm':
+		mflag = optarg;
+		break;
 	case 's':
 		sflag = 1;
 		break;
+	case 'U':
+		Uflag = 1;
+		break;
+	case 'G':
+		Gflag = 1;
+		break;
+	case 'P':
+		Pflag = 1;
+		break;
+	case 'n':
+		nflag = optarg;
+		break;
+	case 'H':
+		Hflag = 1;
+		Hival = atoi(optarg);
+		break;
+	case 'T':
+		Tflag = atoi(optarg);
+		if(Tflag <= 0)
+			sysfatal("-T wants n[:secs]");
+		p = strchr(optarg, ':');
+		if(p != NULL)
+			Tival = atoi(p+1);
+		break;
+	case 'E':
+		Eflag = 1;
+		Eival = atoi(optarg);
+		break;
+	case 'L':
+		Lflag = 1;
+		Lival = atoi(optarg);
+		break;
+	case 'Q':
+		Qflag = 1;
+		Qival = atoi(optarg);
+		break;
 	case 'h':
 		p = optarg;
 		root = findproto(p);
@@ -229,8 +356,8 @@ main(int argc, char **argv)
 		}
 	}
 
-	if(pcap)
-		pcaphdr();
+	if(Pflag)
+		profinit();
 
 	/* next un-processed arg is the [packet-source] */
 	if(argc == optind){
@@ -240,6 +367,16 @@ main(int argc, char **argv)
 	} else
 		file = argv[optind];
 
+	packet = 0;
+#ifdef __linux__
+	if((!tiflag) && strncmp(file, "packet!", 7) == 0){
+		/* opened once there's a filter, see below */
+		if(root == NULL)
+			root = &ether;
+		fd = -1;
+		packet = 1;
+	} else
+#endif
 	if((!tiflag) && strstr(file, "ether")){
 		if(root == NULL)
 			root = &ether;
@@ -265,43 +402,286 @@ main(int argc, char **argv)
 		if(fd < 0)
 			sysfatal("Error opening %s: %r", file);
 	}
-	filter = compile(filter);
+#ifdef __linux__
+	/* before anything big is allocated */
+	if(nflag != NULL)
+		numabind(nflag, packet ? file+7 : NULL);
+#endif
+	if(nouts > 0)
+		openouts();
+	else {
+		filter = compile(filter);
+		if(pcap && !Hflag && !Tflag && !Eflag && !Lflag && !Qflag)
+			pcaphdr(1);
+	}
+#ifdef __linux__
+	if(packet){
+		fd = openworkers(file+7, wflag, mflag);
+		if(fd < 0){
+			printstats();
+			exit(0);
+		}
+		if(root == &ether)
+			kernelfilter(fd);
+	}
+	if(Uflag && uringinit(packet && wflag > 1) < 0)
+		Uflag = 0;
+#else
+	Uflag = 0;
+#endif
 
 	if(tiflag){
-		/* read a trace file */
-		for(;;){
-			n = read(fd, pkt, 10);
-			if(n != 10)
-				break;
-			pkttime = NetL(pkt+2);
-			pkttime = (pkttime<<32) | NetL(pkt+6);
-			if(starttime == 0LL)
-				starttime = pkttime;
-			n = NetS(pkt);
-			if(readn(fd, pkt, n) != n)
-				break;
-			if(filterpkt(filter, pkt, pkt+n, root, 1)){
-				if(toflag)
-					tracepkt(pkt, n);
-				else
-					printpkt(buf, e, pkt, pkt+n);
-			}
-		}
+		/* read a trace file, a batch at a time */
+		while(readtrace(fd, &b) > 0)
+			dobatch(&b, buf, e);
+#ifdef __linux__
+	} else if(packet){
+		/* frames in place from a packet socket's ring */
+		starttime = epoch_nsec();
+		while(packetbatch(fd, &b) > 0)
+			dobatch(&b, buf, e);
+	} else if(Uflag && root->framer == defaultframer){
+		/* a read per packet, Nbatch of them in flight */
+		starttime = epoch_nsec();
+		while(uread(fd, &b) > 0)
+			dobatch(&b, buf, e);
+#endif
 	} else {
 		/* read a real time stream */
 		starttime = epoch_nsec();
+		b.n = 1;
 		for(;;){
-			n = root->framer(fd, pkt, Pktlen);
-			if(n <= 0)
+			pb = pballoc();
+			n = root->framer(fd, pb->base+Headroom, Pktlen);
+			if(n <= 0){
+				pbfree(pb);
 				break;
-			pkttime = epoch_nsec();
-			if(filterpkt(filter, pkt, pkt+n, root, 1)){
-				if(toflag)
-					tracepkt(pkt, n);
-				else
-					printpkt(buf, e, pkt, pkt+n);
 			}
+			b.pkt[0].ps = pb->base+Headroom;
+			b.pkt[0].pe = b.pkt[0].ps+n;
+			b.pkt[0].time = epoch_nsec();
+			b.pkt[0].buf = pb;
+			dobatch(&b, buf, e);
+		}
+	}
+#ifdef __linux__
+	if(Uflag)
+		uflush(1);
+	if(packet)
+		packetstats(fd);
+#endif
+	if(Pflag)
+		profprint();
+	if(Hflag)
+		hierprint();
+	if(Tflag)
+		topprint();
+	if(Eflag)
+		estprint();
+	if(Lflag)
+		rttprint();
+	if(Qflag)
+		rtpprint();
+#ifdef __linux__
+	if(packet && wflag > 1)
+		exit(0);	/* a worker, the parent prints the sums */
+#endif
+	printstats();
+}
+
+/*
+ *  read up to Nbatch packets from a trace file into pool buffers
+ */
+int
+readtrace(int fd, Batch *b)
+{
+	uint8_t *ps;
+	Pbuf *pb;
+	Pkt *p;
+	int n;
+
+	for(b->n = 0; b->n < Nbatch; b->n++){
+		pb = pballoc();
+		ps = pb->base+Headroom;
+		p = &b->pkt[b->n];
+		n = read(fd, ps, 10);
+		if(n != 10){
+			pbfree(pb);
+			break;
+		}
+		p->time = (uint32_t)NetL(ps+2);
+		p->time = (p->time<<32) | (uint32_t)NetL(ps+6);
+		if(starttime == 0LL)
+			starttime = p->time;
+		n = NetS(ps);
+		if(readn(fd, ps, n) != n){
+			pbfree(pb);
+			break;
 		}
+		p->ps = ps;
+		p->pe = ps+n;
+		p->buf = pb;
+	}
+	return b->n;
+}
+
+/*
+ *  compile the -F filters into one tree and open their files.
+ *  a -f filter goes to standard output alongside them.
+ */
+void
+openouts(void)
+{
+	Out *o;
+
+	if(filter != NULL){
+		if(nouts == Nout)
+			sysfatal("too many -F filters");
+		outs[nouts].name = "-";
+		outs[nouts++].f = filter;
+		filter = NULL;
+	}
+	for(o = outs; o < outs+nouts; o++){
+		if(strcmp(o->name, "-") == 0)
+			o->fd = 1;
+		else {
+			o->fd = open(o->name, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+			if(o->fd < 0)
+				sysfatal("Error creating %s: %r", o->name);
+		}
+		if(!toflag)
+			fprintf(stderr, "%s: ", o->name);
+		o->f = compile(o->f);
+		addmfilter(o->f, o - outs);
+		if(pcap)
+			pcaphdr(o->fd);
+	}
+}
+
+#ifdef __linux__
+/*
+ *  have the kernel drop what none of the filters could match
+ */
+void
+kernelfilter(int fd)
+{
+	Filter *f[Nout];
+	int i;
+
+	if(nouts == 0){
+		bpfattach(fd, &filter, 1, root);
+		return;
+	}
+	for(i = 0; i < nouts; i++)
+		f[i] = outs[i].f;
+	bpfattach(fd, f, nouts, root);
+}
+#endif
+
+/*
+ *  send one packet to each output in the mask, formatting it only once
+ */
+static void
+output(Pkt *p, uint32_t match, char *buf, char *e)
+{
+	char *pe;
+	int i;
+
+	pkttime = p->time;
+	pe = NULL;
+	for(i = 0; i < nouts; i++){
+		if((match & (1u<<i)) == 0)
+			continue;
+		if(toflag)
+			tracepkt(p, outs[i].fd);
+		else {
+			if(pe == NULL)
+				pe = seprintpkt(buf, e, p->ps, p->pe);
+			writeall(outs[i].fd, buf, pe - buf);
+		}
+	}
+}
+
+/*
+ *  -H, -T, -E, -L and -Q count the packets that match instead of printing them
+ */
+static int
+tally(Pkt *p)
+{
+	if(!Hflag && !Tflag && !Eflag && !Lflag && !Qflag)
+		return 0;
+	if(Hflag)
+		hieradd(p);
+	if(Tflag)
+		topadd(p);
+	if(Eflag)
+		estadd(p);
+	if(Lflag)
+		rttadd(p);
+	if(Qflag)
+		rtpadd(p);
+	return 1;
+}
+
+/*
+ *  filter a batch and print or trace the packets that match
+ */
+void
+dobatch(Batch *b, char *buf, char *e)
+{
+	uint32_t match;
+	uint64_t t;
+	Pkt *p;
+	int i;
+
+	if(Pflag && lastbatch != 0)
+		profadd(Pread, NULL, lastbatch);
+	t = 0;
+	if(nouts > 0){
+		for(i = 0; i < b->n; i++){
+			p = &b->pkt[i];
+			if(Pflag)
+				t = cycles();
+			match = mfilterpkt(p->ps, p->pe, root);
+			if(Pflag)
+				profadd(Pfilter, NULL, t);
+			if(!match || !sample(p))
+				continue;
+			if(!tally(p))
+				output(p, match, buf, e);
+		}
+		goto out;
+	}
+
+	if(Pflag)
+		t = cycles();
+	match = batchfilter(filter, b, root);
+	if(Pflag && b->n > 0)
+		profaddn(Pfilter, NULL, t, b->n);	/* per packet, as for -F */
+	for(i = 0; i < b->n; i++){
+		if((match & (1u<<i)) == 0)
+			continue;
+		p = &b->pkt[i];
+		if(!sample(p))
+			continue;
+		pkttime = p->time;
+		if(tally(p))
+			continue;
+		if(toflag)
+			tracepkt(p, 1);
+		else
+			printpkt(buf, e, p->ps, p->pe, 1);
+	}
+out:
+#ifdef __linux__
+	/* get this batch's output going */
+	if(Uflag)
+		uflush(0);
+#endif
+	batchfree(b);
+	if(Pflag){
+		profcheck();
+		lastbatch = cycles();
 	}
 }
 
@@ -317,6 +697,64 @@ newfilter(void)
 	return f;
 }
 
+/*
+ *  apply the test of a WORD node, leaving m at the next header.
+ *  a test already made on this packet is answered from the memo.
+ */
+int
+wordtest(Filter *f, Msg *m)
+{
+	uint64_t t;
+	Proto *pr;
+	int ok;
+
+	if(f->pr == &dump)
+		return skiphdrs(m);
+	if(f->blen)
+		return bytesmatch(f, m);
+	pr = m->pr;
+	if(pr->filter == NULL)
+		return 0;
+	if(!Pflag)
+		return (pr->filter)(f, m);
+	t = cycles();
+	ok = (pr->filter)(f, m);
+	profadd(Pdecode, pr, t);
+	return ok;
+}
+
+int
+filterword(Filter *f, Msg *m)
+{
+	Memo *c;
+
+	/* dump can hang anywhere, it's wherever the headers end */
+	if(m->needroot && f->pr != &dump){
+		if(m->pr != f->pr)
+			return 0;
+		m->needroot = 0;
+		return 1;
+	}
+	m->needroot = 0;
+	if(m->pr == NULL)
+		return 1;
+	if(f->memo == 0)
+		return wordtest(f, m);
+
+	c = &memo[f->memo];
+	if(c->gen != memogen){
+		c->gen = memogen;
+		c->ok = wordtest(f, m);
+		c->ps = m->ps;
+		c->pe = m->pe;
+	}
+	if(c->ok){
+		m->ps = c->ps;
+		m->pe = c->pe;
+	}
+	return c->ok;
+}
+
 /*
  *  apply filter to packet
  */
@@ -338,14 +776,8 @@ _filterpkt(Filter *f, Msg *m)
 		ma = *m;
 		return _filterpkt(f->l, &ma) || _filterpkt(f->r, m);
 	case WORD:
-		if(m->needroot){
-			if(m->pr != f->pr)
-				return 0;
-			m->needroot = 0;
-		}else{
-			if(m->pr && (m->pr->filter==NULL || !(m->pr->filter)(f, m)))
-				return 0;
-		}
+		if(!filterword(f, m))
+			return 0;
 		if(f->l == NULL)
 			return 1;
 		m->pr = f->pr;
@@ -362,6 +794,7 @@ filterpkt(Filter *f, uint8_t *ps, uint8_t *pe, Proto *pr, int needroot)
 	if(f == NULL)
 		return 1;
 
+	memogen++;
 	m.needroot = needroot;
 	m.ps = ps;
 	m.pe = pe;
@@ -397,7 +830,7 @@ struct pcap_pkthdr {
  *  pcap trace header 
  */
 void
-pcaphdr(void)
+pcaphdr(int fd)
 {
 	struct pcap_file_header hdr;
 
@@ -410,7 +843,7 @@ pcaphdr(void)
 	hdr.sigfigs = 0;
 	hdr.linktype = 1;
 
-	write(1, &hdr, sizeof(hdr));
+	write(fd, &hdr, sizeof(hdr));
 }
 
 /* This is a bit hacky, assuming the world is ethernet. */
@@ -430,11 +863,16 @@ static char fake_ethernet_header[] = {
  *  write out a packet trace
  */
 void
-tracepkt(uint8_t *ps, int len)
+tracepkt(Pkt *p, int fd)
 {
 	struct pcap_pkthdr *goo;
 	size_t hdrlen = Pcaphdrlen;
 	char *fake_eth;
+	uint8_t *ps;
+	int len;
+
+	ps = p->ps;
+	len = p->pe - p->ps;
 
 	if(Mflag && len > Mflag)
 		len = Mflag;
@@ -454,26 +892,27 @@ tracepkt(uint8_t *ps, int len)
 			fake_eth = (char*)goo + Pcaphdrlen;
 			memcpy(fake_eth, fake_ethernet_header, Fakeethhdrlen);
 		}
-		write(1, goo, len + Pcaphdrlen);
+		writepkt(fd, (char*)goo, len + Pcaphdrlen, p->buf);
 	} else {
 		hnputs(ps-10, len);
 		hnputl(ps-8, pkttime>>32);
 		hnputl(ps-4, pkttime);
-		write(1, ps-10, len+10);
+		writepkt(fd, (char*)ps-10, len+10, p->buf);
 	}
 }
 
 /*
- *  format and print a packet
+ *  format a packet, return the end of the text
  */
-void
-printpkt(char *p, char *e, uint8_t *ps, uint8_t *pe)
+char*
+seprintpkt(char *p, char *e, uint8_t *ps, uint8_t *pe)
 {
 	Msg m;
+	Proto *pr;
 	uint32_t dt;
-	ssize_t ret;
-	size_t sofar, amt;
+	uint64_t t;
 
+	t = 0;
 	dt = (pkttime-starttime)/1000000LL;
 	m.p = seprint(p, e, "%6.6lu ms ", dt);
 	m.ps = ps;
@@ -484,26 +923,77 @@ printpkt(char *p, char *e, uint8_t *ps, uint8_t *pe)
 		if(!sflag)
 			m.p = seprint(m.p, m.e, "\n\t");
 		m.p = seprint(m.p, m.e, "%s(", m.pr->name);
-		if((*m.pr->seprint)(&m) < 0){
+		pr = m.pr;
+		if(Pflag)
+			t = cycles();
+		if((*pr->seprint)(&m) < 0){
 			m.p = seprint(m.p, m.e, "TOO SHORT");
 			m.ps = m.pe;
 		}
+		if(Pflag)
+			profadd(Pprint, pr, t);
 		m.p = seprint(m.p, m.e, ")");
 		if(m.pr == NULL || m.ps >= m.pe)
 			break;
 	}
 	*m.p++ = '\n';
+	return m.p;
+}
+
+void
+writeall(int fd, char *p, int amt)
+{
+	ssize_t ret;
+	size_t sofar;
+	uint64_t t;
 
+	t = Pflag ? cycles() : 0;
 	sofar = 0;
-	amt = m.p - p;
+#ifdef __linux__
+	if(Uflag)
+		uwrite(fd, p, amt);
+	else
+#endif
 	while (amt - sofar) {
-		ret = write(1, p + sofar, amt - sofar);
+		ret = write(fd, p + sofar, amt - sofar);
 		if (ret < 0) {
 			sysfatal( "Error writing to stdout: %r");
 			break;
 		}
 		sofar += ret;
 	}
+	if(Pflag)
+		profadd(Pwrite, NULL, t);
+}
+
+/*
+ *  write bytes of a packet and its headroom.  with -U a
+ *  pool buffer can go to the kernel as it is.
+ */
+void
+writepkt(int fd, char *p, int amt, Pbuf *pb)
+{
+	uint64_t t;
+
+#ifdef __linux__
+	if(Uflag){
+		t = Pflag ? cycles() : 0;
+		uwritepkt(fd, p, amt, pb);
+		if(Pflag)
+			profadd(Pwrite, NULL, t);
+		return;
+	}
+#endif
+	writeall(fd, p, amt);
+}
+
+/*
+ *  format and print a packet
+ */
+void
+printpkt(char *p, char *e, uint8_t *ps, uint8_t *pe, int fd)
+{
+	writeall(fd, p, seprintpkt(p, e, ps, pe) - p);
 }
 
 Proto **xprotos;
@@ -640,6 +1130,8 @@ Filter*
 complete(Filter *f, Proto *last)
 {
 	Proto *pr;
+	Filter *nf;
+	char *p;
 
 	if(f == NULL)
 		return f;
@@ -655,7 +1147,21 @@ complete(Filter *f, Proto *last)
 		f->r = complete(f->r, last);
 		break;
 	case '=':
-		break;
+	case '@':
+		/* proto[off:len]=x becomes proto([off:len]=x) */
+		p = strchr(f->l->s, '[');
+		if(p == NULL || p == f->l->s)
+			break;
+		nf = newfilter();
+		nf->op = WORD;
+		nf->s = strndup(f->l->s, p - f->l->s);
+		nf->l = f;
+		p = strdup(p);
+		if(nf->s == NULL || p == NULL)
+			sysfatal("complete: %r");
+		free(f->l->s);
+		f->l->s = p;
+		return complete(nf, last);
 	case WORD:
 		pr = findproto(f->s);
 		f->pr = pr;
@@ -665,6 +1171,9 @@ complete(Filter *f, Proto *last)
 					f->s);
 				f->l = NULL;
 			}
+		} else if(pr == &dump){
+			/* no path to fill in, see filterword */
+			f->l = complete(f->l, pr);
 		} else {
 			f->l = complete(f->l, pr);
 			f = fillin(f, last);
@@ -773,7 +1282,7 @@ findbogus(Filter *f)
 		if(f->r)
 			rv |= findbogus(f->r);
 		return rv;
-	} else if(f->pr != root){
+	} else if(f->pr != root && f->pr != &dump){
 		fprintf(stderr, "bad top-level protocol: %s\n", f->s);
 		return 1;
 	}
@@ -799,7 +1308,7 @@ _compile(Filter *f, Proto *last)
 		_compile(f->r, last);
 		break;
 	case WORD:
-		if(last != NULL){
+		if(last != NULL && f->pr != &dump){
 			if(last->compile == NULL)
 				sysfatal( "unknown %s subprotocol: %s", f->pr->name, f->s);
 			(*last->compile)(f);
@@ -807,10 +1316,19 @@ _compile(Filter *f, Proto *last)
 		if(f->l)
 			_compile(f->l, f->pr);
 		break;
+	case '@':
+		/* modules only know '=', compile_cmp sees the '@' */
+		f->op = '=';
+		f->r->op = '@';
+		/* fall through */
 	case '=':
 		if(last == NULL)
 			sysfatal( "internal error: compilewalk: badly formed tree");
 		
+		if(f->l->s[0] == '['){
+			compile_bytes(f);
+			break;
+		}
 		if(last->compile == NULL)
 			sysfatal( "unknown %s field: %s", f->pr->name, f->s);
 		(*last->compile)(f);
@@ -843,6 +1361,9 @@ compile(Filter *f)
 		exit(1);
 	}
 
+	/* share tests made more than once */
+	cse(f);
+
 	return f;
 }
 
@@ -871,13 +1392,15 @@ parseba(uint8_t *to, char *from)
 }
 
 /*
- *  compile WORD = WORD, becomes a single node with a subop
+ *  compile WORD = WORD, becomes a single node with a subop.
+ *  WORD @ WORD compares with a set read from a file.
  */
 void
 compile_cmp(char *proto, Filter *f, Field *fld)
 {
-#if 0       
 	uint8_t x[IPaddrlen];
+	int64_t v4;
+#if 0       
 	char *v;
 #endif
 	if(f->op != '=')
@@ -885,17 +1408,39 @@ compile_cmp(char *proto, Filter *f, Field *fld)
 
 	for(; fld->name != NULL; fld++){
 		if(strcmp(f->l->s, fld->name) == 0){
+			if(f->r->op == '@'){
+				f->op = WORD;
+				f->subop = fld->subop;
+				f->set = loadset(f->r->s, fld->ftype);
+				f->l = f->r = NULL;
+				return;
+			}
 			f->op = WORD;
 			f->subop = fld->subop;
+			if(isset(f->r->s, fld->ftype)){
+				f->set = parseset(f->r->s, fld->ftype);
+				f->l = f->r = NULL;
+				return;
+			}
 			switch(fld->ftype){
 			case Fnum:
 				f->ulv = atoi(f->r->s);
 				break;
 			case Fether:
+				if(parseether(f->a, f->r->s) < 0)
+					sysfatal("bad ether address: %s", f->r->s);
+				break;
 			case Fv4ip:
+				v4 = parseip(x, f->r->s);
+				if(v4 == -1 || !isv4(x))
+					sysfatal("bad ip address: %s", f->r->s);
+				f->ulv = v4;
+				break;
 			case Fv6ip:
-				sysfatal("Sorry, not supported yet");
+				if(parseip(f->a, f->r->s) == -1)
+					sysfatal("bad ip6 address: %s", f->r->s);
 				break;
+			/* name lookups need ndb */
 #if 0
 			case Fether:
 				v = csgetvalue(NULL, "sys", (char*)f->r->s,
@@ -968,6 +1513,7 @@ _pf(Filter *f)
 		s = "||";
 		goto print;
 	case '=':
+	case '@':
 	print:
 		_pf(f->l);
 		if(s)
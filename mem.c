@@ -0,0 +1,166 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  where the big things live.  bigalloc is for the memory walked
+ *  or filled per packet: the packet pool, output buffers and tables.
+ *  on linux it's 2MB pages, from the reserved hugepages with -G and
+ *  transparent ones otherwise, so a walk doesn't take a TLB miss per
+ *  4K page.
+ *
+ *  -n node binds our memory and cpus to a NUMA node, so none of it
+ *  is across the interconnect from the other.  -n nic is the node
+ *  the capture interface hangs off.  workers inherit the binding.
+ */
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+#include "ip.h"
+#include "dat.h"
+
+int Gflag;
+
+enum
+{
+	Hugepage=	2*1024*1024,
+	Maxnode=	1024,
+};
+
+#ifdef __linux__
+static int	nohuge;
+
+/*
+ *  n zeroed bytes
+ */
+void*
+bigalloc(size_t n)
+{
+	void *p;
+
+	n = (n + Hugepage-1) & ~(size_t)(Hugepage-1);
+	if(Gflag && !nohuge){
+		p = mmap(NULL, n, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|MAP_POPULATE, -1, 0);
+		if(p != MAP_FAILED)
+			return p;
+		fprintf(stderr, "no hugepages reserved, using transparent ones: %s\n",
+			strerror(errno));
+		nohuge = 1;
+	}
+	p = mmap(NULL, n, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(p == MAP_FAILED)
+		sysfatal("bigalloc: %r");
+	madvise(p, n, MADV_HUGEPAGE);
+	return p;
+}
+
+/*
+ *  the cpus on node, from its cpulist: 0-7,16-23
+ */
+static void
+nodecpus(int node, cpu_set_t *cs)
+{
+	char file[128], buf[1024], *p;
+	int fd, n, lo, hi;
+
+	CPU_ZERO(cs);
+	snprintf(file, sizeof file, "/sys/devices/system/node/node%d/cpulist", node);
+	fd = open(file, O_RDONLY);
+	if(fd < 0)
+		sysfatal("no numa node %d: %r", node);
+	n = read(fd, buf, sizeof buf - 1);
+	close(fd);
+	if(n <= 0)
+		sysfatal("reading %s: %r", file);
+	buf[n] = 0;
+	for(p = buf; *p >= '0' && *p <= '9'; ){
+		lo = hi = strtol(p, &p, 10);
+		if(*p == '-')
+			hi = strtol(p+1, &p, 10);
+		for(; lo <= hi && lo < CPU_SETSIZE; lo++)
+			CPU_SET(lo, cs);
+		if(*p == ',')
+			p++;
+	}
+}
+
+/*
+ *  the node ifname's device is on, -1 if the kernel doesn't say
+ */
+static int
+nicnode(const char *ifname)
+{
+	char file[128], buf[32];
+	int fd, n;
+
+	snprintf(file, sizeof file, "/sys/class/net/%s/device/numa_node", ifname);
+	fd = open(file, O_RDONLY);
+	if(fd < 0)
+		return -1;
+	n = read(fd, buf, sizeof buf - 1);
+	close(fd);
+	if(n <= 0)
+		return -1;
+	buf[n] = 0;
+	return atoi(buf);
+}
+
+/*
+ *  run on node's cpus and take memory only from it
+ */
+void
+numabind(char *node, const char *ifname)
+{
+	unsigned long mask[Maxnode/(8*sizeof(unsigned long))];
+	cpu_set_t cs;
+	int n;
+
+	if(strcmp(node, "nic") == 0){
+		if(ifname == NULL)
+			sysfatal("-n nic needs a packet!ifname source");
+		n = nicnode(ifname);
+		if(n < 0){
+			fprintf(stderr, "%s has no numa node, not binding\n", ifname);
+			return;
+		}
+	} else
+		n = atoi(node);
+	if(n < 0 || n >= Maxnode)
+		sysfatal("bad numa node %s", node);
+
+	nodecpus(n, &cs);
+	if(sched_setaffinity(0, sizeof cs, &cs) < 0)
+		sysfatal("binding to node %d's cpus: %r", n);
+	memset(mask, 0, sizeof mask);
+	mask[n/(8*sizeof(unsigned long))] |= 1UL << n%(8*sizeof(unsigned long));
+	if(syscall(__NR_set_mempolicy, MPOL_BIND, mask, Maxnode) < 0)
+		sysfatal("binding to node %d's memory: %r", n);
+}
+#else
+void*
+bigalloc(size_t n)
+{
+	void *p;
+
+	p = calloc(1, n);
+	if(p == NULL)
+		sysfatal("bigalloc: %r");
+	return p;
+}
+#endif
@@ -0,0 +1,148 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  many named filters applied in one walk.  the compiled filters are
+ *  merged into a tree of header tests: filters that start with the
+ *  same chain of WORD nodes share those nodes, and an | is split so
+ *  each side merges on its own, the same as optimize() does within a
+ *  single filter.  whatever can't be merged (&, !) hangs off the tree
+ *  as a leaf and is run by _filterpkt.  a walk returns the bit mask
+ *  of the filters that matched.
+ */
+#include "ip.h"
+#include "dat.h"
+#include "y.tab.h"
+
+typedef struct Dnode Dnode;
+typedef struct Dleaf Dleaf;
+
+/*
+ *  a leftover filter under a Dnode
+ */
+struct Dleaf
+{
+	Filter	*f;
+	uint32_t	out;
+	Dleaf	*next;
+};
+
+/*
+ *  a header test shared by all the filters below it
+ */
+struct Dnode
+{
+	Filter	*f;	/* the WORD node, NULL at the top */
+	uint32_t	out;	/* filters that match once here */
+	uint32_t	below;	/* filters anywhere under this node */
+	Dleaf	*leaf;
+	Dnode	*kid;
+	Dnode	*next;
+};
+
+extern int	_filterpkt(Filter*, Msg*);
+
+static Dnode	top;
+
+static void
+insert(Dnode *d, Filter *f, uint32_t out)
+{
+	Dnode *k;
+	Dleaf *l;
+
+	d->below |= out;
+	if(f == NULL){
+		d->out |= out;
+		return;
+	}
+
+	switch(f->op){
+	case LOR:
+		insert(d, f->l, out);
+		insert(d, f->r, out);
+		return;
+	case WORD:
+		for(k = d->kid; k != NULL; k = k->next)
+			if(sametest(k->f, f))
+				break;
+		if(k == NULL){
+			k = calloc(1, sizeof *k);
+			if(k == NULL)
+				sysfatal("addmfilter: %r");
+			k->f = f;
+			k->next = d->kid;
+			d->kid = k;
+		}
+		insert(k, f->l, out);
+		return;
+	}
+
+	l = malloc(sizeof *l);
+	if(l == NULL)
+		sysfatal("addmfilter: %r");
+	l->f = f;
+	l->out = out;
+	l->next = d->leaf;
+	d->leaf = l;
+}
+
+/*
+ *  add compiled filter f, which reports as bit n
+ */
+void
+addmfilter(Filter *f, int n)
+{
+	if(n >= 32)
+		sysfatal("too many filters");
+	insert(&top, f, 1u<<n);
+}
+
+/*
+ *  walk the tree, skipping anything that can only report
+ *  filters that have already matched
+ */
+static uint32_t
+_mfilterpkt(Dnode *d, Msg *m, uint32_t got)
+{
+	Dnode *k;
+	Dleaf *l;
+	Msg ma;
+
+	got |= d->out;
+	for(l = d->leaf; l != NULL; l = l->next){
+		if((l->out & ~got) == 0)
+			continue;
+		ma = *m;
+		if(_filterpkt(l->f, &ma))
+			got |= l->out;
+	}
+	for(k = d->kid; k != NULL; k = k->next){
+		if((k->below & ~got) == 0)
+			continue;
+		ma = *m;
+		if(!filterword(k->f, &ma))
+			continue;
+		ma.pr = k->f->pr;
+		got = _mfilterpkt(k, &ma, got);
+	}
+	return got;
+}
+
+uint32_t
+mfilterpkt(uint8_t *ps, uint8_t *pe, Proto *pr)
+{
+	Msg m;
+
+	memogen++;
+	m.needroot = 1;
+	m.ps = ps;
+	m.pe = pe;
+	m.pr = pr;
+	return _mfilterpkt(&top, &m, 0);
+}
@@ -0,0 +1,276 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  packet!ifname: a linux packet socket, promiscuous, whole
+ *  ethernet frames.  the kernel fills a TPACKET_V3 ring of blocks
+ *  that we map; a batch points at the frames in the current block,
+ *  which goes back to the kernel when we ask for the batch after
+ *  its last.  nothing is copied.  if the ring can't be set up, each
+ *  read of the socket returns one frame, into a pool buffer.
+ *
+ *  with -w n, n worker processes each open their own socket and ring
+ *  and join a fanout group, so the kernel deals the packets out among
+ *  them by flow hash or by the cpu they arrived on.
+ */
+#ifdef __linux__
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include "ip.h"
+#include "dat.h"
+
+enum
+{
+	Blocksize=	1<<20,
+	Nblock=	64,
+	Framesize=	2048,	/* only a hint to the kernel in V3 */
+	Blocktmo=	10,	/* ms before a part full block is handed over */
+};
+
+typedef struct Ring Ring;
+struct Ring
+{
+	uint8_t	*base;
+	int	cur;		/* block being read */
+	int	npkt;		/* frames left in it */
+	struct tpacket3_hdr	*next;
+};
+
+static Ring	*ring;
+static volatile sig_atomic_t	stopping;
+
+static void
+mkring(int fd)
+{
+	struct tpacket_req3 req;
+	int v;
+	void *p;
+
+	v = TPACKET_V3;
+	if(setsockopt(fd, SOL_PACKET, PACKET_VERSION, &v, sizeof v) < 0)
+		goto nope;
+	v = Headroom;
+	if(setsockopt(fd, SOL_PACKET, PACKET_RESERVE, &v, sizeof v) < 0)
+		goto nope;
+	memset(&req, 0, sizeof req);
+	req.tp_block_size = Blocksize;
+	req.tp_block_nr = Nblock;
+	req.tp_frame_size = Framesize;
+	req.tp_frame_nr = Blocksize/Framesize * Nblock;
+	req.tp_retire_blk_tov = Blocktmo;
+	if(setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof req) < 0)
+		goto nope;
+	p = mmap(NULL, Blocksize*Nblock, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_LOCKED, fd, 0);
+	if(p == MAP_FAILED)
+		p = mmap(NULL, Blocksize*Nblock, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if(p == MAP_FAILED)
+		goto nope;
+	ring = calloc(1, sizeof *ring);
+	if(ring == NULL)
+		sysfatal("mkring: %r");
+	ring->base = p;
+	return;
+nope:
+	fprintf(stderr, "no packet ring, reading frames one at a time: %s\n",
+		strerror(errno));
+}
+
+static int
+openpacket(const char *ifname)
+{
+	struct sockaddr_ll sll;
+	struct packet_mreq mr;
+	int fd, ifindex;
+
+	ifindex = if_nametoindex(ifname);
+	if(ifindex == 0)
+		sysfatal("unknown interface %s", ifname);
+	fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+	if(fd < 0)
+		sysfatal("Error opening packet socket: %r");
+
+	/* the ring has to be there before the bind */
+	mkring(fd);
+
+	memset(&sll, 0, sizeof sll);
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = ifindex;
+	if(bind(fd, (struct sockaddr*)&sll, sizeof sll) < 0)
+		sysfatal("Error binding to %s: %r", ifname);
+
+	memset(&mr, 0, sizeof mr);
+	mr.mr_ifindex = ifindex;
+	mr.mr_type = PACKET_MR_PROMISC;
+	if(setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr, sizeof mr) < 0)
+		sysfatal("Error setting %s promiscuous: %r", ifname);
+	return fd;
+}
+
+static void
+stop(int _)
+{
+	stopping = 1;
+}
+
+/*
+ *  open ifname in n workers, returning the socket in each.  the
+ *  parent waits for them, adds up their counts and returns -1.
+ */
+int
+openworkers(const char *ifname, int n, char *mode)
+{
+	struct sigaction sa;
+	Stats *ws;
+	int i, fd, type, arg;
+
+	/* no SA_RESTART, poll has to see the interrupt */
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	if(n <= 1)
+		return openpacket(ifname);
+
+	if(mode == NULL || strcmp(mode, "hash") == 0)
+		type = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG;
+	else if(strcmp(mode, "cpu") == 0)
+		type = PACKET_FANOUT_CPU;
+	else
+		sysfatal("unknown fanout mode %s", mode);
+
+	ws = mmap(NULL, n*sizeof(Stats), PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(ws == MAP_FAILED)
+		sysfatal("openworkers: %r");
+	memset(ws, 0, n*sizeof(Stats));
+	for(i = 0; i < n; i++){
+		switch(fork()){
+		case -1:
+			sysfatal("fork: %r");
+		case 0:
+			stats = &ws[i];
+			if(Rflag > 0)
+				Rflag = (Rflag + n-1) / n;
+			fd = openpacket(ifname);
+			arg = (getppid() & 0xffff) | type<<16;
+			if(setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof arg) < 0)
+				sysfatal("Error joining fanout group: %r");
+			return fd;
+		}
+	}
+	while(wait(NULL) > 0 || errno == EINTR)
+		;
+	for(i = 0; i < n; i++)
+		addstats(&ws[i]);
+	return -1;
+}
+
+/*
+ *  what the kernel saw and dropped on fd
+ */
+void
+packetstats(int fd)
+{
+	struct tpacket_stats_v3 st;
+	socklen_t len;
+
+	len = sizeof st;
+	memset(&st, 0, sizeof st);
+	if(getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) < 0)
+		return;
+	stats->pkts += st.tp_packets;
+	stats->drops += st.tp_drops;
+}
+
+static struct tpacket_block_desc*
+block(int n)
+{
+	return (struct tpacket_block_desc*)(ring->base + n*Blocksize);
+}
+
+/*
+ *  the next batch of frames, waiting for a block if need be
+ */
+int
+packetbatch(int fd, Batch *b)
+{
+	struct tpacket_block_desc *bd;
+	struct tpacket3_hdr *h;
+	struct pollfd pfd;
+	Pbuf *pb;
+	Pkt *p;
+	int n;
+
+	if(stopping)
+		return 0;
+	if(ring == NULL){
+		pb = pballoc();
+		n = read(fd, pb->base+Headroom, Pktlen);
+		if(n <= 0){
+			pbfree(pb);
+			return 0;
+		}
+		b->n = 1;
+		b->pkt[0].ps = pb->base+Headroom;
+		b->pkt[0].pe = b->pkt[0].ps+n;
+		b->pkt[0].time = epoch_nsec();
+		b->pkt[0].buf = pb;
+		return 1;
+	}
+
+	bd = block(ring->cur);
+	if(ring->next != NULL && ring->npkt == 0){
+		/* done with the last batch of this block */
+		__sync_synchronize();
+		bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+		ring->cur = (ring->cur+1) % Nblock;
+		ring->next = NULL;
+		bd = block(ring->cur);
+	}
+	if(ring->next == NULL){
+		while((bd->hdr.bh1.block_status & TP_STATUS_USER) == 0){
+			if(stopping)
+				return 0;
+			pfd.fd = fd;
+			pfd.events = POLLIN|POLLERR;
+			pfd.revents = 0;
+			if(poll(&pfd, 1, -1) < 0 && errno != EINTR)
+				return 0;
+		}
+		__sync_synchronize();
+		ring->npkt = bd->hdr.bh1.num_pkts;
+		ring->next = (struct tpacket3_hdr*)((uint8_t*)bd + bd->hdr.bh1.offset_to_first_pkt);
+	}
+
+	for(b->n = 0; b->n < Nbatch && ring->npkt > 0; b->n++){
+		h = ring->next;
+		p = &b->pkt[b->n];
+		p->ps = (uint8_t*)h + h->tp_mac;
+		p->pe = p->ps + h->tp_snaplen;
+		p->time = h->tp_sec*1000000000LL + h->tp_nsec;
+		p->buf = NULL;
+		ring->next = (struct tpacket3_hdr*)((uint8_t*)h + h->tp_next_offset);
+		ring->npkt--;
+	}
+	if(b->n == 0)
+		return packetbatch(fd, b);	/* an empty block */
+	return b->n;
+}
+#endif
@@ -0,0 +1,118 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  a fixed pool of packet buffers, each with Headroom bytes in front
+ *  of the packet for tracepkt's headers.  a packet is read into one
+ *  and the buffer goes from stage to stage by its Pbuf, never copied.
+ *  anything that keeps a packet past its batch, like a write still in
+ *  flight, takes a reference; the buffer is free when the last one
+ *  goes.  one process uses a pool, so the counts aren't atomic.
+ *  the pool is bigalloc'd, in hugepages.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "ip.h"
+#include "dat.h"
+
+enum
+{
+	Npbuf=	16*Nbatch,
+	Pbuflen=	Headroom + Pktlen,
+};
+
+static Pbuf	*pbufs;
+static Pbuf	*pbfreel;
+static uint8_t	*pool;
+static size_t	poollen;
+
+static void
+pbinit(void)
+{
+	int i;
+
+	poollen = Npbuf*(size_t)Pbuflen;
+	pool = bigalloc(poollen);
+	pbufs = calloc(Npbuf, sizeof(Pbuf));
+	if(pbufs == NULL)
+		sysfatal("pbinit: %r");
+	for(i = Npbuf-1; i >= 0; i--){
+		pbufs[i].base = pool + i*(size_t)Pbuflen;
+		pbufs[i].next = pbfreel;
+		pbfreel = &pbufs[i];
+	}
+}
+
+/*
+ *  where the pool is, for registering it with the kernel
+ */
+void
+pbpool(uint8_t **base, size_t *len)
+{
+	if(pool == NULL)
+		pbinit();
+	*base = pool;
+	*len = poollen;
+}
+
+/*
+ *  a free buffer with one reference.  when they're all taken, wait
+ *  for writes holding them to finish.
+ */
+Pbuf*
+pballoc(void)
+{
+	Pbuf *pb;
+
+	if(pool == NULL)
+		pbinit();
+	while(pbfreel == NULL){
+#ifdef __linux__
+		if(Uflag && uwait())
+			continue;
+#endif
+		sysfatal("out of packet buffers");
+	}
+	pb = pbfreel;
+	pbfreel = pb->next;
+	pb->ref = 1;
+	return pb;
+}
+
+void
+pbref(Pbuf *pb)
+{
+	pb->ref++;
+}
+
+void
+pbfree(Pbuf *pb)
+{
+	if(pb->ref <= 0)
+		sysfatal("internal error: pbfree of a free buffer");
+	if(--pb->ref > 0)
+		return;
+	pb->next = pbfreel;
+	pbfreel = pb;
+}
+
+/*
+ *  let go of a batch's packets
+ */
+void
+batchfree(Batch *b)
+{
+	int i;
+
+	for(i = 0; i < b->n; i++)
+		if(b->pkt[i].buf != NULL){
+			pbfree(b->pkt[i].buf);
+			b->pkt[i].buf = NULL;
+		}
+}
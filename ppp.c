@@ -178,7 +178,7 @@ p_filter(Filter *f, Msg *m)
 	if((proto&1) == 0)
 		proto = (proto<<8) | *m->ps++;
 
-	if(proto == f->ulv)
+	if(fmatch(f, proto))
 		return 1;
 
 	return 0;
@@ -101,13 +101,13 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Overs:
-		return (h->verstype>>4) == f->ulv;
+		return fmatch(f, h->verstype>>4);
 	case Otype:
-		return (h->verstype&0xF) == f->ulv;
+		return fmatch(f, h->verstype&0xF);
 	case Ocode:
-		return h->code == f->ulv;
+		return fmatch(f, h->code);
 	case Osess:
-		return NetS(h->sessid) == f->ulv;
+		return fmatch(f, NetS(h->sessid));
 	}
 	return 0;
 }
@@ -0,0 +1,258 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  -P: where the time goes.  each stage, and each protocol's filter
+ *  and seprint, gets a histogram of how long a call took, in cycles
+ *  where there's a time stamp counter and ns where there isn't.
+ *  buckets are a power of two split in four, so a percentile is good
+ *  to a quarter.  printed at exit, and when a SIGUSR1 comes in, after
+ *  the batch it came during.  stages nest: filter includes the
+ *  protocol filters under it and the read time includes waiting for
+ *  packets.  filter is a call per packet, a batch filtered at once
+ *  sharing its time out among its packets.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include "ip.h"
+#include "dat.h"
+
+int Pflag;
+
+enum
+{
+	Nsub=	4,	/* buckets per power of two */
+	Nbucket=	64*Nsub,
+	Nslot=	128,	/* stages plus two per protocol */
+	Ibits=	8,
+	Nindex=	1<<Ibits,	/* twice Nslot */
+};
+
+typedef struct Hist Hist;
+struct Hist
+{
+	char	name[32];
+	Proto	*pr;
+	int	stage;
+	uint64_t	n;
+	uint64_t	sum;
+	uint64_t	max;
+	uint64_t	b[Nbucket];
+};
+
+static char *stagename[] = {
+[Pread]		"read",
+[Pfilter]	"filter",
+[Pwrite]	"write",
+[Pdecode]	"filter",
+[Pprint]	"seprint",
+};
+
+static Hist	hist[Nslot];
+static int	nhist;
+static uint8_t	slots[Nindex];	/* hist index+1, by hash of stage and protocol */
+static volatile sig_atomic_t	wantprint;
+
+uint64_t
+cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void
+usr1(int _)
+{
+	wantprint = 1;
+}
+
+void
+profinit(void)
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = usr1;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &sa, NULL);
+}
+
+/*
+ *  the histogram for a stage, or for a protocol's stage.  found by
+ *  hashing, as this is on the path of every protocol filter call.
+ */
+static Hist*
+slot(int stage, Proto *pr)
+{
+	Hist *h;
+	int i;
+
+	i = (uint32_t)(((uintptr_t)pr >> 4) + stage) * 2654435761U >> (32-Ibits);
+	for(; slots[i] != 0; i = (i+1) & (Nindex-1)){
+		h = &hist[slots[i]-1];
+		if(h->stage == stage && h->pr == pr)
+			return h;
+	}
+	if(nhist == Nslot)
+		return NULL;
+	slots[i] = nhist+1;
+	h = &hist[nhist++];
+	h->stage = stage;
+	h->pr = pr;
+	if(pr != NULL)
+		snprintf(h->name, sizeof h->name, "%s.%s", pr->name, stagename[stage]);
+	else
+		snprintf(h->name, sizeof h->name, "%s", stagename[stage]);
+	return h;
+}
+
+static int
+bucket(uint64_t x)
+{
+	int l;
+
+	if(x < Nsub)
+		return x;
+	l = 63 - __builtin_clzll(x);
+	return (l-2)*Nsub + (x >> (l-2));
+}
+
+static uint64_t
+bucketmax(int i)
+{
+	int l;
+
+	if(i < Nsub)
+		return i;
+	l = i/Nsub + 1;
+	return (((uint64_t)(i%Nsub) + Nsub + 1) << (l-2)) - 1;
+}
+
+/*
+ *  account for n calls of stage, for pr if it's a protocol's, made
+ *  together from t0 and taking equal shares of the time
+ */
+void
+profaddn(int stage, Proto *pr, uint64_t t0, int n)
+{
+	uint64_t dt;
+	Hist *h;
+
+	dt = (cycles() - t0) / n;
+	h = slot(stage, pr);
+	if(h == NULL)
+		return;
+	h->n += n;
+	h->sum += dt*n;
+	if(dt > h->max)
+		h->max = dt;
+	h->b[bucket(dt)] += n;
+}
+
+/*
+ *  account for a call of stage that started at t0
+ */
+void
+profadd(int stage, Proto *pr, uint64_t t0)
+{
+	profaddn(stage, pr, t0, 1);
+}
+
+static uint64_t
+pct(Hist *h, int p)
+{
+	uint64_t want, seen;
+	int i;
+
+	want = (h->n*p + 99)/100;
+	seen = 0;
+	for(i = 0; i < Nbucket; i++){
+		seen += h->b[i];
+		if(seen >= want)
+			break;
+	}
+	if(i == Nbucket || bucketmax(i) > h->max)
+		return h->max;
+	return bucketmax(i);
+}
+
+/*
+ *  the stages first, then the protocols that took the most
+ */
+static int
+histcmp(const void *a, const void *b)
+{
+	Hist *x, *y;
+
+	x = *(Hist**)a;
+	y = *(Hist**)b;
+	if((x->pr == NULL) != (y->pr == NULL))
+		return x->pr == NULL ? -1 : 1;
+	if(x->pr == NULL)
+		return x->stage - y->stage;
+	if(x->sum != y->sum)
+		return x->sum > y->sum ? -1 : 1;
+	return 0;
+}
+
+/*
+ *  in one write, so workers' tables don't interleave
+ */
+void
+profprint(void)
+{
+	char buf[Nslot*100], *p, *e;
+	Hist *h, *sorted[Nslot];
+	int i;
+
+	if(nhist == 0)
+		return;
+	for(i = 0; i < nhist; i++)
+		sorted[i] = &hist[i];
+	qsort(sorted, nhist, sizeof sorted[0], histcmp);
+	p = buf;
+	e = buf + sizeof buf;
+	p = seprint(p, e, "%-20s %10s %12s %8s %8s %8s %10s %s, pid %d\n", "stage",
+		"calls", "total", "mean", "p50", "p99", "max",
+#if defined(__x86_64__) || defined(__i386__)
+		"cycles",
+#else
+		"ns",
+#endif
+		getpid());
+	for(i = 0; i < nhist; i++){
+		h = sorted[i];
+		p = seprint(p, e, "%-20s %10llu %12llu %8llu %8llu %8llu %10llu\n", h->name,
+			(unsigned long long)h->n, (unsigned long long)h->sum,
+			(unsigned long long)(h->sum/h->n),
+			(unsigned long long)pct(h, 50), (unsigned long long)pct(h, 99),
+			(unsigned long long)h->max);
+	}
+	write(2, buf, p - buf);
+}
+
+/*
+ *  print if a SIGUSR1 asked for it
+ */
+void
+profcheck(void)
+{
+	if(!wantprint)
+		return;
+	wantprint = 0;
+	profprint();
+}
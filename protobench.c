@@ -0,0 +1,364 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  protobench [-n iters] [-h first-header] trace...
+ *
+ *  time each protocol module's filter and seprint on their own.  the
+ *  traces (snoopy -t format, see gentrace.c) are walked the way
+ *  seprintpkt walks them, and up to Nsample headers are kept per
+ *  module, each with copies cut short in the middle and just before
+ *  its end.  modules that never turn up get random bytes.  every
+ *  module's filter is tried with a compare on each of its fields and
+ *  a test for each protocol it muxes to.
+ *
+ *  each input set is run once to warm the caches and then iters
+ *  times, and the table gives cycles a call (ns where there's no time
+ *  stamp counter) for the whole headers and for the cut ones.
+ *
+ *  linked with snoopy's objects, whose main the Makefile renames.
+ */
+#include "ip.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include "dat.h"
+#include "protos.h"
+#include "y.tab.h"
+
+#undef main
+
+enum
+{
+	Nsample=	64,
+	Ncut=	3,
+	Nfilt=	16,
+	Maxdepth=	16,
+	Randlen=	64,
+	Outlen=	16*1024,
+};
+
+typedef struct In In;
+struct In
+{
+	uint8_t	*p;
+	int	n;
+};
+
+typedef struct Bench Bench;
+struct Bench
+{
+	Proto	*pr;
+	int	rand;		/* never seen, inputs are random */
+	In	valid[Nsample];
+	int	nvalid;
+	In	cut[Nsample*Ncut];
+	int	ncut;
+	Filter	*f[Nfilt];
+	int	nf;
+};
+
+extern Proto	*root;
+extern int64_t	starttime;
+extern Filter*	newfilter(void);
+extern int	readtrace(int, Batch*);
+extern void	mkprotograph(void);
+extern Proto*	findproto(char*);
+extern void	installfmts(void);
+
+static Bench	*bench;
+static int	nbench;
+static char	out[Outlen];
+static volatile int	sink;
+static uint64_t	seed = 1;
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: protobench [-n iters] [-h first-header] trace...\n");
+	exit(1);
+}
+
+static uint8_t
+rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed >> 24;
+}
+
+static Bench*
+lookup(Proto *pr)
+{
+	int i;
+
+	for(i = 0; i < nbench; i++)
+		if(bench[i].pr == pr)
+			return &bench[i];
+	return NULL;
+}
+
+static void
+add(In *in, uint8_t *p, int n)
+{
+	in->p = malloc(n > 0 ? n : 1);
+	if(in->p == NULL)
+		sysfatal("protobench: %r");
+	memmove(in->p, p, n);
+	in->n = n;
+}
+
+/*
+ *  a header of b's module at ps, hlen of it being the header proper:
+ *  keep it and cuts at half and one short of hlen
+ */
+static void
+keep(Bench *b, uint8_t *ps, uint8_t *pe, int hlen)
+{
+	int cut[Ncut];
+	int i, nc;
+
+	if(b->nvalid == Nsample)
+		return;
+	add(&b->valid[b->nvalid++], ps, pe-ps);
+	nc = 0;
+	if(hlen > 1)
+		cut[nc++] = hlen-1;
+	if(hlen > 3)
+		cut[nc++] = hlen/2;
+	if(hlen > 0)
+		cut[nc++] = 0;
+	for(i = 0; i < nc; i++)
+		add(&b->cut[b->ncut++], ps, cut[i]);
+}
+
+/*
+ *  walk a packet's headers as seprintpkt does
+ */
+static void
+collect(uint8_t *ps, uint8_t *pe)
+{
+	uint8_t *hs;
+	Bench *b;
+	Msg m;
+	int d;
+
+	m.ps = ps;
+	m.pe = pe;
+	m.pr = root;
+	m.needroot = 0;
+	for(d = 0; d < Maxdepth && m.pr != NULL && m.ps < m.pe; d++){
+		hs = m.ps;
+		b = lookup(m.pr);
+		m.p = out;
+		m.e = out+sizeof out;
+		if((*m.pr->seprint)(&m) < 0)
+			break;
+		if(b != NULL)
+			keep(b, hs, m.pe, m.ps - hs);
+	}
+}
+
+static void
+randomize(Bench *b)
+{
+	uint8_t x[Randlen];
+	int i, j;
+
+	b->rand = 1;
+	for(i = 0; i < Nsample; i++){
+		for(j = 0; j < Randlen; j++)
+			x[j] = rnd();
+		keep(b, x, x+Randlen, 1 + i%Randlen);
+	}
+}
+
+/*
+ *  a compare on each field with a value of the right type, and a
+ *  test for each protocol muxed to
+ */
+static void
+mkfilters(Bench *b)
+{
+	Proto *pr;
+	Field *fl;
+	Mux *mx;
+	Filter *f;
+	char *v;
+
+	pr = b->pr;
+	if(pr->filter == NULL || pr->compile == NULL)
+		return;
+	for(fl = pr->field; fl != NULL && fl->name != NULL && b->nf < Nfilt; fl++){
+		switch(fl->ftype){
+		case Fnum:
+			v = "0";
+			break;
+		case Fether:
+			v = "000000000000";
+			break;
+		case Fv4ip:
+			v = "0.0.0.0";
+			break;
+		case Fv6ip:
+			v = "::";
+			break;
+		default:
+			continue;
+		}
+		f = newfilter();
+		f->op = '=';
+		f->l = newfilter();
+		f->l->op = WORD;
+		f->l->s = fl->name;
+		f->r = newfilter();
+		f->r->op = WORD;
+		f->r->s = v;
+		(*pr->compile)(f);
+		b->f[b->nf++] = f;
+	}
+	for(mx = pr->mux; mx != NULL && mx->name != NULL && b->nf < Nfilt; mx++){
+		f = newfilter();
+		f->op = WORD;
+		f->s = mx->name;
+		(*pr->compile)(f);
+		b->f[b->nf++] = f;
+	}
+}
+
+static void
+filterloop(Bench *b, In *in, int nin)
+{
+	Msg m;
+	int i, j;
+
+	for(i = 0; i < nin; i++)
+		for(j = 0; j < b->nf; j++){
+			m.ps = in[i].p;
+			m.pe = in[i].p + in[i].n;
+			m.pr = b->pr;
+			m.needroot = 0;
+			sink += (*b->pr->filter)(b->f[j], &m);
+		}
+}
+
+static void
+seprintloop(Bench *b, In *in, int nin)
+{
+	Msg m;
+	int i;
+
+	for(i = 0; i < nin; i++){
+		m.ps = in[i].p;
+		m.pe = in[i].p + in[i].n;
+		m.pr = b->pr;
+		m.needroot = 0;
+		m.p = out;
+		m.e = out+sizeof out;
+		sink += (*b->pr->seprint)(&m);
+	}
+}
+
+/*
+ *  cycles a call of loop over in, warm
+ */
+static double
+timeit(void (*loop)(Bench*, In*, int), Bench *b, In *in, int nin, int ncall, int iters)
+{
+	uint64_t t0;
+	int i;
+
+	if(nin == 0 || ncall == 0)
+		return -1;
+	(*loop)(b, in, nin);
+	t0 = cycles();
+	for(i = 0; i < iters; i++)
+		(*loop)(b, in, nin);
+	return (double)(cycles() - t0) / ((double)iters*nin*ncall);
+}
+
+static void
+cell(double c)
+{
+	if(c < 0)
+		printf(" %9s", "-");
+	else
+		printf(" %9.1f", c);
+}
+
+int
+main(int argc, char **argv)
+{
+	Batch bt;
+	Bench *b;
+	char *p;
+	int c, i, fd, iters;
+
+	installfmts();
+	mkprotograph();
+	root = &ether;
+	iters = 1000;
+	while((c = getopt(argc, argv, "n:h:")) != -1){
+		switch(c){
+		case 'n':
+			iters = atoi(optarg);
+			if(iters <= 0)
+				usage();
+			break;
+		case 'h':
+			p = optarg;
+			root = findproto(p);
+			if(root == NULL)
+				sysfatal("unknown protocol: %s", p);
+			break;
+		default:
+			usage();
+		}
+	}
+	if(optind == argc)
+		usage();
+
+	for(nbench = 0; protos[nbench] != NULL; nbench++)
+		;
+	bench = calloc(nbench, sizeof *bench);
+	if(bench == NULL)
+		sysfatal("protobench: %r");
+	for(i = 0; i < nbench; i++)
+		bench[i].pr = protos[i];
+
+	for(; optind < argc; optind++){
+		fd = open(argv[optind], O_RDONLY);
+		if(fd < 0)
+			sysfatal("can't open %s: %r", argv[optind]);
+		starttime = 0;
+		while(readtrace(fd, &bt) > 0){
+			for(i = 0; i < bt.n; i++)
+				collect(bt.pkt[i].ps, bt.pkt[i].pe);
+			batchfree(&bt);
+		}
+		close(fd);
+	}
+
+	printf("%-12s %-5s %5s %5s %9s %9s %9s %9s\n", "proto", "from",
+		"whole", "cut", "filter", "cut", "seprint", "cut");
+	for(b = bench; b < bench+nbench; b++){
+		if(b->nvalid == 0)
+			randomize(b);
+		mkfilters(b);
+		printf("%-12s %-5s %5d %5d", b->pr->name, b->rand ? "rand" : "trace",
+			b->nvalid, b->ncut);
+		cell(timeit(filterloop, b, b->valid, b->nvalid, b->nf, iters));
+		cell(timeit(filterloop, b, b->cut, b->ncut, b->nf, iters));
+		cell(timeit(seprintloop, b, b->valid, b->nvalid, 1, iters));
+		cell(timeit(seprintloop, b, b->cut, b->ncut, 1, iters));
+		printf("\n");
+	}
+	return 0;
+}
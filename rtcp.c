@@ -79,6 +79,25 @@ p_seprint(Msg *m)
 	return 0;
 }
 
+/*
+ *  a compound starting with a sender or receiver report, whose
+ *  lengths add up
+ */
+static int
+p_detect(uint8_t *p, uint8_t *e)
+{
+	int len;
+
+	if(e - p < 8 || (p[0]>>6) != 2 || (p[1] != 200 && p[1] != 201))
+		return 0;
+	for(; e - p >= 4; p += len){
+		len = (NetS(p+2) + 1) * 4;
+		if((p[0]>>6) != 2 || p[1] < 200 || p[1] > 204 || len > e - p)
+			return 0;
+	}
+	return p == e;
+}
+
 Proto rtcp = {
 	"rtcp",
 	NULL,
@@ -88,4 +107,6 @@ Proto rtcp = {
 	NULL,
 	NULL,
 	defaultframer,
+	NULL,
+	p_detect,
 };
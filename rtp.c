@@ -57,6 +57,26 @@ p_seprint(Msg *m)
 	return 0;
 }
 
+/*
+ *  version 2, a payload type that can't be taken for rtcp's, and the
+ *  csrcs and padding fit
+ */
+static int
+p_detect(uint8_t *p, uint8_t *e)
+{
+	int len, pt;
+
+	len = e - p;
+	if(len < RTPLEN || (p[0]>>6) != 2 || RTPLEN + 4*(p[0]&0xf) > len)
+		return 0;
+	pt = p[1] & 0x7f;
+	if(pt >= 72 && pt <= 76)
+		return 0;
+	if((p[0] & 0x20) && (p[len-1] == 0 || p[len-1] > len - RTPLEN))
+		return 0;
+	return 1;
+}
+
 Proto rtp = {
 	"rtp",
 	NULL,
@@ -66,4 +86,6 @@ Proto rtp = {
 	NULL,
 	NULL,
 	defaultframer,
+	NULL,
+	p_detect,
 };
@@ -0,0 +1,455 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  -Q secs: the quality of the rtp streams in the matching udp
+ *  packets, instead of printing them.  every secs of packet time,
+ *  unless secs is 0, and at the end, each stream heard from gets a
+ *  line: packets, loss, duplicates and packets out of order since
+ *  the last one, the interarrival jitter, and what the rtcp sender
+ *  and receiver reports about it say.
+ *
+ *  a udp payload is rtcp if its packet type is 200 to 204 and rtp
+ *  otherwise, as when they share a port (rfc 5761); a stream has to
+ *  get MINSEQ packets in a row before it counts.  sequence numbers
+ *  and jitter are kept as in rfc 3550 appendix A.  jitter needs the
+ *  rtp clock rate, which comes from the payload type if it's a
+ *  static one and is worked out from the timestamps if not.
+ *
+ *  streams are keyed by ssrc and source in a table of Nstream, a
+ *  new one pushing out the one heard from least lately near its slot.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "ip.h"
+#include "dat.h"
+
+int Qflag;
+int Qival;
+
+enum
+{
+	Sec=	1000000000LL,
+	Nstream=	16384,	/* a power of 2 */
+	Nprobe=	8,
+
+	Tudp=	17,
+
+	RTPLEN=	12,
+	MINSEQ=	2,		/* in a row to be a stream */
+	MAXDROPOUT=	3000,
+	MAXMISORDER=	100,
+	SEQMOD=	1<<16,
+
+	Psr=	200,
+	Prr=	201,
+	Papp=	204,
+};
+
+typedef struct Stream Stream;
+struct Stream
+{
+	uint32_t	ssrc;
+	uint8_t	used;
+	uint8_t	pt;
+	uint8_t	probation;
+	uint8_t	rtcp;		/* got a report about it */
+	int64_t	last;
+	uint8_t	src[IPaddrlen];
+	uint8_t	dst[IPaddrlen];
+	uint16_t	sport;
+	uint16_t	dport;
+
+	/* rfc 3550 A.1 */
+	uint16_t	maxseq;
+	uint32_t	cycles;
+	uint32_t	baseseq;
+	uint32_t	badseq;
+	uint32_t	received;
+	uint32_t	expprior;
+	uint32_t	recprior;
+	uint64_t	seen;		/* bit i: maxseq-i came */
+	uint32_t	dups;		/* since the last summary */
+	uint32_t	reord;
+
+	/* rfc 3550 A.8, jitter in 1/16ths of a tick */
+	uint32_t	rate;
+	uint32_t	transit;
+	uint32_t	jitter;
+	int64_t	t0;		/* for working out the rate */
+	uint32_t	ts0;
+
+	/* rtcp */
+	uint32_t	srpkts;
+	uint8_t	rrfrac;
+	int32_t	rrlost;
+	uint32_t	rrjitter;
+};
+
+extern Proto *root;
+extern int64_t starttime;
+
+static Stream	*stream;
+static int64_t	nextprint, from;
+
+static int rates[] = { 8000, 16000, 24000, 32000, 44100, 48000, 90000 };
+
+/*
+ *  rtp clock rate of the static payload types (rfc 3551)
+ */
+static uint32_t
+ptrate(int pt)
+{
+	switch(pt){
+	case 0: case 3: case 4: case 5: case 7: case 8: case 9:
+	case 12: case 13: case 15: case 18:
+		return 8000;
+	case 6:
+		return 16000;
+	case 10: case 11:
+		return 44100;
+	case 16:
+		return 11025;
+	case 17:
+		return 22050;
+	case 25: case 26: case 28: case 31: case 32: case 33: case 34:
+		return 90000;
+	}
+	return 0;
+}
+
+static Stream*
+lookup(uint32_t ssrc, Flow *fl, int64_t now)
+{
+	Stream *s, *old;
+	uint32_t h;
+	int i;
+
+	h = ssrc * 2654435761U;
+	old = NULL;
+	for(i = 0; i < Nprobe; i++){
+		s = &stream[(h+i) & (Nstream-1)];
+		if(s->used && s->ssrc == ssrc && s->sport == fl->sport
+		&& memcmp(s->src, fl->src, IPaddrlen) == 0){
+			s->last = now;
+			return s;
+		}
+		/* an empty slot, or else the one idle longest */
+		if(old == NULL || (!s->used && old->used)
+		|| (s->used == old->used && s->last < old->last))
+			old = s;
+	}
+
+	s = old;
+	memset(s, 0, sizeof *s);
+	s->used = 1;
+	s->ssrc = ssrc;
+	s->last = now;
+	memmove(s->src, fl->src, IPaddrlen);
+	memmove(s->dst, fl->dst, IPaddrlen);
+	s->sport = fl->sport;
+	s->dport = fl->dport;
+	s->probation = MINSEQ;
+	return s;
+}
+
+/*
+ *  a stream an rtcp report is about, from any source
+ */
+static Stream*
+find(uint32_t ssrc)
+{
+	Stream *s;
+	uint32_t h;
+	int i;
+
+	h = ssrc * 2654435761U;
+	for(i = 0; i < Nprobe; i++){
+		s = &stream[(h+i) & (Nstream-1)];
+		if(s->used && s->ssrc == ssrc)
+			return s;
+	}
+	return NULL;
+}
+
+static void
+initseq(Stream *s, uint16_t seq)
+{
+	s->baseseq = seq;
+	s->maxseq = seq;
+	s->badseq = SEQMOD+1;
+	s->cycles = 0;
+	s->received = 0;
+	s->recprior = 0;
+	s->expprior = 0;
+	s->seen = 1;
+}
+
+/*
+ *  returns 0 for a packet that doesn't count
+ */
+static int
+updateseq(Stream *s, uint16_t seq)
+{
+	uint16_t udelta, back;
+
+	udelta = seq - s->maxseq;
+	if(s->probation){
+		if(seq == (uint16_t)(s->maxseq+1)){
+			s->probation--;
+			s->maxseq = seq;
+			if(s->probation == 0){
+				initseq(s, seq);
+				s->received++;
+				return 1;
+			}
+		} else {
+			s->probation = MINSEQ-1;
+			s->maxseq = seq;
+		}
+		return 0;
+	}
+	if(udelta == 0){
+		s->dups++;
+		return 0;
+	}
+	if(udelta < MAXDROPOUT){
+		if(seq < s->maxseq)
+			s->cycles += SEQMOD;
+		s->maxseq = seq;
+		s->seen = udelta >= 64 ? 1 : s->seen<<udelta | 1;
+	} else if(udelta <= SEQMOD - MAXMISORDER){
+		/* a big jump, if the next follows it the source restarted */
+		if(seq != s->badseq){
+			s->badseq = (seq+1) & (SEQMOD-1);
+			return 0;
+		}
+		initseq(s, seq);
+	} else {
+		back = s->maxseq - seq;
+		if(back < 64){
+			if(s->seen & 1ULL<<back){
+				s->dups++;
+				return 0;
+			}
+			s->seen |= 1ULL<<back;
+		}
+		s->reord++;
+	}
+	s->received++;
+	return 1;
+}
+
+/*
+ *  the clock rate of a dynamic payload type, once there's half a
+ *  second of packets to go by, rounded to a usual one
+ */
+static void
+guessrate(Stream *s, uint32_t ts, int64_t now)
+{
+	double r;
+	int i;
+
+	if(s->t0 == 0){
+		s->t0 = now;
+		s->ts0 = ts;
+		return;
+	}
+	if(now - s->t0 < Sec/2)
+		return;
+	r = (double)(uint32_t)(ts - s->ts0) * Sec / (now - s->t0);
+	s->rate = r + 0.5;
+	for(i = 0; i < sizeof rates/sizeof rates[0]; i++)
+		if(r > rates[i]*0.95 && r < rates[i]*1.05)
+			s->rate = rates[i];
+}
+
+static void
+rtp(Flow *fl, uint8_t *p, uint8_t *e, int64_t now)
+{
+	uint32_t ts, arrival, transit;
+	int32_t d;
+	Stream *s;
+
+	if(e - p < RTPLEN || RTPLEN + 4*(p[0]&0xf) > e - p)
+		return;
+	s = lookup(NetL(p+8), fl, now);
+	s->pt = p[1] & 0x7f;
+	if(!updateseq(s, NetS(p+2)))
+		return;
+
+	ts = NetL(p+4);
+	if(s->rate == 0)
+		s->rate = ptrate(s->pt);
+	if(s->rate == 0){
+		guessrate(s, ts, now);
+		if(s->rate == 0)
+			return;
+	}
+	arrival = (now - starttime) / 1000 * s->rate / 1000000;
+	transit = arrival - ts;
+	if(s->transit != 0){
+		d = transit - s->transit;
+		if(d < 0)
+			d = -d;
+		s->jitter += d - ((s->jitter + 8) >> 4);
+	}
+	s->transit = transit;
+}
+
+/*
+ *  note what the sender and receiver reports in a compound rtcp
+ *  packet say about the streams
+ */
+static void
+rtcp(uint8_t *p, uint8_t *e)
+{
+	uint8_t *q, *b;
+	Stream *s;
+	int len, rc;
+
+	for(; e - p >= 8; p += len){
+		len = (NetS(p+2) + 1) * 4;
+		if((p[0]>>6) != 2 || len > e - p)
+			return;
+		rc = p[0] & 0x1f;
+		switch(p[1]){
+		case Psr:
+			if(len < 28)
+				return;
+			s = find(NetL(p+4));
+			if(s != NULL)
+				s->srpkts = NetL(p+20);
+			b = p+28;
+			break;
+		case Prr:
+			b = p+8;
+			break;
+		default:
+			continue;
+		}
+		for(q = b; rc-- > 0 && q+24 <= p+len; q += 24){
+			s = find(NetL(q));
+			if(s == NULL)
+				continue;
+			s->rtcp = 1;
+			s->rrfrac = q[4];
+			s->rrlost = (int32_t)((uint32_t)Net3(q+5) << 8) >> 8;
+			s->rrjitter = NetL(q+12);
+		}
+	}
+}
+
+/*
+ *  look at a matching udp packet
+ */
+void
+rtpadd(Pkt *p)
+{
+	int64_t ival;
+	uint8_t *u;
+	Flow fl;
+
+	if(stream == NULL)
+		stream = bigalloc(Nstream*sizeof(Stream));
+	if(Qival > 0 && p->time >= nextprint){
+		if(nextprint != 0)
+			rtpprint();
+		ival = (int64_t)Qival*Sec;
+		from = starttime + (p->time - starttime)/ival * ival;
+		nextprint = from + ival;
+	}
+	if(!flowkey(&fl, p->ps, p->pe, root) || fl.proto != Tudp || fl.l4 == NULL)
+		return;
+	u = fl.l4 + 8;
+	if(fl.end - u < 8 || (u[0]>>6) != 2)
+		return;
+	if(u[1] >= Psr && u[1] <= Papp)
+		rtcp(u, fl.end);
+	else
+		rtp(&fl, u, fl.end, p->time);
+}
+
+static char*
+seprintaddr(char *p, char *e, uint8_t *a, int port)
+{
+	if(isv4(a))
+		return seprint(p, e, "%V!%d", a+IPaddrlen-4, port);
+	return seprint(p, e, "%I!%d", a, port);
+}
+
+static double
+jitterms(uint32_t j, uint32_t rate)
+{
+	if(rate == 0)
+		return 0;
+	return 1000.0 * j / rate;
+}
+
+/*
+ *  a line a stream heard from since the last time, starting it over.
+ *  in one write, so workers' lines don't interleave.
+ */
+void
+rtpprint(void)
+{
+	char *buf, *p, *e;
+	uint32_t expected, rec, exp;
+	int32_t lost;
+	Stream *s;
+	size_t n;
+	int ns;
+
+	if(stream == NULL)
+		return;
+	ns = 0;
+	for(s = stream; s < stream+Nstream; s++)
+		if(s->used && !s->probation && s->received != s->recprior)
+			ns++;
+	if(ns == 0)
+		return;
+	n = (ns+1)*300;
+	buf = malloc(n);
+	if(buf == NULL)
+		sysfatal("rtpprint: %r");
+	p = buf;
+	e = buf + n;
+	if(Qival > 0)
+		p = seprint(p, e, "%lld s: ", (long long)((from - starttime)/Sec));
+	p = seprint(p, e, "%d rtp streams, pid %d\n", ns, getpid());
+	for(s = stream; s < stream+Nstream; s++){
+		if(!s->used || s->probation || s->received == s->recprior)
+			continue;
+		expected = s->cycles + s->maxseq - s->baseseq + 1;
+		exp = expected - s->expprior;
+		rec = s->received - s->recprior;
+		lost = exp - rec;
+		s->expprior = expected;
+		s->recprior = s->received;
+
+		p = seprint(p, e, "  ssrc=%08x ", s->ssrc);
+		p = seprintaddr(p, e, s->src, s->sport);
+		p = seprint(p, e, " -> ");
+		p = seprintaddr(p, e, s->dst, s->dport);
+		p = seprint(p, e, " pt=%d pkts=%u lost=%d (%.1f%%) dup=%u reord=%u",
+			s->pt, rec, lost, exp ? 100.0*lost/exp : 0.0, s->dups, s->reord);
+		if(s->rate != 0)
+			p = seprint(p, e, " jitter=%.2fms", jitterms(s->jitter>>4, s->rate));
+		if(s->srpkts != 0)
+			p = seprint(p, e, " sr.pkts=%u", s->srpkts);
+		if(s->rtcp)
+			p = seprint(p, e, " rr.lost=%d (%.1f%%) rr.jitter=%.2fms", s->rrlost,
+				100.0*s->rrfrac/256, jitterms(s->rrjitter, s->rate));
+		p = seprint(p, e, "\n");
+		s->dups = 0;
+		s->reord = 0;
+	}
+	write(1, buf, p - buf);
+	free(buf);
+}
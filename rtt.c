@@ -0,0 +1,421 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  -L secs: round trip times of the matching tcp conversations, seen
+ *  from where we capture, instead of printing the packets.  the
+ *  server's side is syn to syn/ack and the client's data to the ack
+ *  that covers it; the client's side is syn/ack to ack and the
+ *  server's data to its ack.  one segment a direction is timed at a
+ *  time, and not if it's sent again (karn).  without a syn the lower
+ *  port is taken to be the server.
+ *
+ *  conversations live in a table of Nconv, a new one pushing out the
+ *  one seen least lately near its slot.  each keeps a histogram of
+ *  its server side, all of them together get one per side.  printed,
+ *  with the conversations slowest at the 90th percentile, every secs
+ *  of packet time and then started over, unless secs is 0, and at the
+ *  end.  times are in us, histogram buckets are a power of two split
+ *  in Nsub, so percentiles are good to an eighth.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "ip.h"
+#include "dat.h"
+
+int Lflag;
+int Lival;
+
+enum
+{
+	Sec=	1000000000LL,
+	Nsub=	8,
+	Nbucket=	32*Nsub,
+	Nconv=	8192,	/* a power of 2 */
+	Nprobe=	8,
+	Nslow=	10,
+
+	Ttcp=	6,
+
+	Fin=	0x01,
+	Syn=	0x02,
+	Rst=	0x04,
+	Ack=	0x10,
+
+	/* handshake */
+	Snone=	0,
+	Ssyn,
+	Ssynack,
+
+	Server=	0,
+	Client,
+};
+
+typedef struct Hist Hist;
+struct Hist
+{
+	uint64_t	n;
+	uint64_t	max;
+	uint32_t	b[Nbucket];
+};
+
+typedef struct Seg Seg;
+struct Seg
+{
+	int	timing;
+	uint32_t	end;	/* seq the ack has to reach */
+	int64_t	t;
+};
+
+typedef struct Conv Conv;
+struct Conv
+{
+	uint8_t	addr[2][IPaddrlen];	/* server, client */
+	uint16_t	port[2];
+	uint32_t	h;
+	int	used;
+	int64_t	last;
+
+	int	state;
+	uint32_t	isn[2];
+	int64_t	t;		/* of the syn or syn/ack */
+	Seg	seg[2];		/* data sent by each side */
+	Hist	hist;		/* server side */
+};
+
+extern Proto *root;
+extern int64_t starttime;
+
+static Conv	*conv;
+static Hist	all[2];
+static int64_t	nextprint, from;
+
+static char *sidename[2] = {
+[Server]	"server",
+[Client]	"client",
+};
+
+/* serial number arithmetic */
+static int
+seqge(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) >= 0;
+}
+
+static int
+bucket(uint64_t x)
+{
+	int l;
+
+	if(x < Nsub)
+		return x;
+	l = 63 - __builtin_clzll(x);
+	if(l >= 32)
+		return Nbucket-1;
+	return (l-3)*Nsub + (x >> (l-3));
+}
+
+static uint64_t
+bucketmax(int i)
+{
+	int l;
+
+	if(i < Nsub)
+		return i;
+	l = i/Nsub + 2;
+	return (((uint64_t)(i%Nsub) + Nsub + 1) << (l-3)) - 1;
+}
+
+static void
+histadd(Hist *h, uint64_t x)
+{
+	h->n++;
+	if(x > h->max)
+		h->max = x;
+	h->b[bucket(x)]++;
+}
+
+static uint64_t
+pct(Hist *h, int p)
+{
+	uint64_t want, seen;
+	int i;
+
+	want = (h->n*p + 99)/100;
+	seen = 0;
+	for(i = 0; i < Nbucket; i++){
+		seen += h->b[i];
+		if(seen >= want)
+			break;
+	}
+	if(i == Nbucket || bucketmax(i) > h->max)
+		return h->max;
+	return bucketmax(i);
+}
+
+/*
+ *  which side of c sent fl, or -1 if it isn't c's
+ */
+static int
+sender(Conv *c, Flow *fl)
+{
+	int s;
+
+	for(s = 0; s < 2; s++)
+		if(c->port[s] == fl->sport && c->port[!s] == fl->dport
+		&& memcmp(c->addr[s], fl->src, IPaddrlen) == 0
+		&& memcmp(c->addr[!s], fl->dst, IPaddrlen) == 0)
+			return s;
+	return -1;
+}
+
+/*
+ *  the conversation between fl's ends, new if need be.
+ *  *side is the side that sent fl.
+ */
+static Conv*
+lookup(Flow *fl, int64_t now, int *side)
+{
+	Conv *c, *old;
+	uint32_t h;
+	int i, s;
+
+	h = flowhash(fl);
+	old = NULL;
+	for(i = 0; i < Nprobe; i++){
+		c = &conv[(h+i) & (Nconv-1)];
+		if(c->used && c->h == h && (s = sender(c, fl)) >= 0){
+			*side = s;
+			c->last = now;
+			return c;
+		}
+		/* an empty slot, or else the one idle longest */
+		if(old == NULL || (!c->used && old->used)
+		|| (c->used == old->used && c->last < old->last))
+			old = c;
+	}
+
+	c = old;
+	memset(c, 0, sizeof *c);
+	c->used = 1;
+	c->h = h;
+	c->last = now;
+	s = fl->sport < fl->dport ? Server : Client;
+	memmove(c->addr[s], fl->src, IPaddrlen);
+	memmove(c->addr[!s], fl->dst, IPaddrlen);
+	c->port[s] = fl->sport;
+	c->port[!s] = fl->dport;
+	*side = s;
+	return c;
+}
+
+/*
+ *  the syn's sender is the client
+ */
+static void
+turn(Conv *c)
+{
+	uint8_t a[IPaddrlen];
+	uint16_t p;
+
+	memmove(a, c->addr[0], IPaddrlen);
+	memmove(c->addr[0], c->addr[1], IPaddrlen);
+	memmove(c->addr[1], a, IPaddrlen);
+	p = c->port[0];
+	c->port[0] = c->port[1];
+	c->port[1] = p;
+}
+
+static void
+took(Conv *c, int side, int64_t dt)
+{
+	if(dt < 0)
+		return;
+	dt /= 1000;
+	histadd(&all[side], dt);
+	if(side == Server)
+		histadd(&c->hist, dt);
+}
+
+static void
+reset(void)
+{
+	Conv *c;
+
+	memset(all, 0, sizeof all);
+	for(c = conv; c < conv+Nconv; c++)
+		if(c->used)
+			memset(&c->hist, 0, sizeof c->hist);
+}
+
+/*
+ *  time a matching tcp segment
+ */
+void
+rttadd(Pkt *p)
+{
+	uint32_t seq, ack, end;
+	int64_t ival;
+	uint8_t *t;
+	Conv *c;
+	Flow fl;
+	Seg *sg;
+	int side, flags, len;
+
+	if(conv == NULL)
+		conv = bigalloc(Nconv*sizeof(Conv));
+	if(Lival > 0 && p->time >= nextprint){
+		if(nextprint != 0){
+			rttprint();
+			reset();
+		}
+		ival = (int64_t)Lival*Sec;
+		from = starttime + (p->time - starttime)/ival * ival;
+		nextprint = from + ival;
+	}
+	if(!flowkey(&fl, p->ps, p->pe, root) || fl.proto != Ttcp || fl.l4 == NULL)
+		return;
+	t = fl.l4;
+	if(fl.end - t < 20 || fl.end - t < (t[12]>>4)*4)
+		return;
+	seq = NetL(t+4);
+	ack = NetL(t+8);
+	flags = t[13];
+	len = fl.end - t - (t[12]>>4)*4;
+	c = lookup(&fl, p->time, &side);
+
+	if(flags & Rst){
+		c->used = 0;
+		return;
+	}
+	if((flags & (Syn|Ack)) == Syn){
+		if(side == Server){
+			turn(c);
+			side = Client;
+		}
+		if(c->state == Ssyn && c->isn[Client] == seq){
+			/* sent again */
+			c->state = Snone;
+			return;
+		}
+		c->state = Ssyn;
+		c->isn[Client] = seq;
+		c->t = p->time;
+		memset(c->seg, 0, sizeof c->seg);
+		return;
+	}
+	if((flags & (Syn|Ack)) == (Syn|Ack)){
+		if(side == Server && c->state == Ssyn && ack == c->isn[Client]+1){
+			took(c, Server, p->time - c->t);
+			c->state = Ssynack;
+			c->isn[Server] = seq;
+			c->t = p->time;
+		}
+		return;
+	}
+	if(c->state == Ssynack && side == Client && (flags & Ack)
+	&& ack == c->isn[Server]+1){
+		took(c, Client, p->time - c->t);
+		c->state = Snone;
+	}
+
+	/* an ack of the other side's timed segment */
+	sg = &c->seg[!side];
+	if((flags & Ack) && sg->timing && seqge(ack, sg->end)){
+		took(c, side, p->time - sg->t);
+		sg->timing = 0;
+	}
+
+	/* time this one if nothing of ours is */
+	if(len == 0 && (flags & Fin) == 0)
+		return;
+	end = seq + len + ((flags & Fin) != 0);
+	sg = &c->seg[side];
+	if(!sg->timing){
+		if(sg->t == 0 || seqge(seq, sg->end)){
+			sg->timing = 1;
+			sg->end = end;
+			sg->t = p->time;
+		}
+	} else if(!seqge(seq, sg->end)){
+		/* sent again, its ack could be for either */
+		sg->timing = 0;
+	}
+}
+
+static char*
+seprintaddr(char *p, char *e, uint8_t *a, int port)
+{
+	if(isv4(a))
+		return seprint(p, e, "%V!%d", a+IPaddrlen-4, port);
+	return seprint(p, e, "%I!%d", a, port);
+}
+
+static char*
+seprinthist(char *p, char *e, Hist *h)
+{
+	return seprint(p, e, " %10llu %8llu %8llu %8llu %8llu\n",
+		(unsigned long long)h->n,
+		(unsigned long long)pct(h, 50), (unsigned long long)pct(h, 90),
+		(unsigned long long)pct(h, 99), (unsigned long long)h->max);
+}
+
+/*
+ *  in one write, so workers' tables don't interleave
+ */
+void
+rttprint(void)
+{
+	char buf[4096], *p, *e, *l;
+	Conv *c, *slow[Nslow+1];
+	uint64_t p90[Nslow+1], x;
+	int i, n;
+
+	if(all[Server].n == 0 && all[Client].n == 0)
+		return;
+
+	/* the slowest, by insertion into a short sorted list */
+	n = 0;
+	for(c = conv; c < conv+Nconv; c++){
+		if(!c->used || c->hist.n == 0)
+			continue;
+		x = pct(&c->hist, 90);
+		for(i = n; i > 0 && p90[i-1] < x; i--){
+			slow[i] = slow[i-1];
+			p90[i] = p90[i-1];
+		}
+		slow[i] = c;
+		p90[i] = x;
+		if(n < Nslow)
+			n++;
+	}
+
+	p = buf;
+	e = buf + sizeof buf;
+	if(Lival > 0)
+		p = seprint(p, e, "%lld s: ", (long long)((from - starttime)/Sec));
+	p = seprint(p, e, "rtt in us, pid %d\n", getpid());
+	p = seprint(p, e, "%-46s %10s %8s %8s %8s %8s\n", "", "samples", "p50", "p90", "p99", "max");
+	for(i = 0; i < 2; i++){
+		p = seprint(p, e, "%-46s", sidename[i]);
+		p = seprinthist(p, e, &all[i]);
+	}
+	for(i = 0; i < n; i++){
+		c = slow[i];
+		l = p;
+		p = seprint(p, e, "  ");
+		p = seprintaddr(p, e, c->addr[Server], c->port[Server]);
+		p = seprint(p, e, " <- ");
+		p = seprintaddr(p, e, c->addr[Client], c->port[Client]);
+		while(p < l+46 && p < e-1)
+			*p++ = ' ';
+		p = seprinthist(p, e, &c->hist);
+	}
+	write(1, buf, p - buf);
+}
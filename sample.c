@@ -0,0 +1,116 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  thin out the matching packets before they're formatted, so a busy
+ *  link can't make printing the bottleneck.  in order:
+ *	-K n	keep the conversations whose flow hash is 0 mod n;
+ *		packets that aren't ip are all kept
+ *	-S n	keep every nth packet
+ *	-R n	keep at most n packets a second, bursts of up to n,
+ *		timed by the packets' own timestamps
+ *  the ones thrown away are only counted.
+ */
+#include <stdio.h>
+#include "ip.h"
+#include "dat.h"
+
+int Kflag;
+int Sflag;
+int Rflag;
+
+enum
+{
+	Sec=	1000000000LL,
+};
+
+extern Proto *root;
+
+static Stats	mystats;
+Stats	*stats = &mystats;
+
+static unsigned long long nth;
+static int64_t credit, lasttime;
+
+/*
+ *  a token bucket of Rflag tokens, refilled at Rflag a second.
+ *  credit is in tokens*Sec so the refill is exact.
+ */
+static int
+tokens(int64_t now)
+{
+	int64_t full;
+
+	full = (int64_t)Rflag*Sec;
+	if(lasttime == 0 || now - lasttime >= Sec)
+		credit = full;
+	else if(now > lasttime){
+		credit += (now - lasttime)*Rflag;
+		if(credit > full)
+			credit = full;
+	}
+	lasttime = now;
+	if(credit < Sec)
+		return 0;
+	credit -= Sec;
+	return 1;
+}
+
+/*
+ *  should a matching packet be printed?
+ */
+int
+sample(Pkt *p)
+{
+	Flow fl;
+
+	stats->match++;
+	if(Kflag > 1 && flowkey(&fl, p->ps, p->pe, root)
+	&& flowhash(&fl) % Kflag != 0){
+		stats->sampled++;
+		return 0;
+	}
+	if(Sflag > 1 && nth++ % Sflag != 0){
+		stats->sampled++;
+		return 0;
+	}
+	if(Rflag > 0 && !tokens(p->time)){
+		stats->limited++;
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ *  add a worker's counts to ours
+ */
+void
+addstats(Stats *s)
+{
+	stats->pkts += s->pkts;
+	stats->drops += s->drops;
+	stats->match += s->match;
+	stats->sampled += s->sampled;
+	stats->limited += s->limited;
+}
+
+void
+printstats(void)
+{
+	if(stats->pkts || stats->drops)
+		fprintf(stderr, "%llu packets, %llu dropped by the kernel\n",
+			(unsigned long long)stats->pkts,
+			(unsigned long long)stats->drops);
+	if(Kflag <= 1 && Sflag <= 1 && Rflag <= 0)
+		return;
+	fprintf(stderr, "%llu matched, %llu sampled out, %llu over the rate limit\n",
+		(unsigned long long)stats->match,
+		(unsigned long long)stats->sampled,
+		(unsigned long long)stats->limited);
+}
@@ -0,0 +1,378 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  sets of values for `field in {a,b,c}', `field=lo..hi',
+ *  `field in a.b.c.d/n' and `field@file'.  numbers are kept as
+ *  sorted, disjoint ranges searched in O(log n), plus a bitmap when
+ *  every value fits in 16 bits (ports, types) so those are O(1).
+ *  addresses go in a prefix trie, see lpm.c.
+ */
+#include <stdio.h>
+#include "ip.h"
+#include "dat.h"
+
+struct Set
+{
+	int	n;
+	uint32_t	*lo;
+	uint32_t	*hi;
+	uint8_t	*bits;
+	Lpm	*lpm;
+};
+
+typedef struct Range Range;
+struct Range
+{
+	uint32_t	lo;
+	uint32_t	hi;
+};
+
+/*
+ *  does the value look like a set rather than a single value?
+ */
+int
+isset(char *s, int ftype)
+{
+	if(*s == '{' || strstr(s, "..") != NULL)
+		return 1;
+	return (ftype == Fv4ip || ftype == Fv6ip) && strchr(s, '/') != NULL;
+}
+
+static uint32_t
+parsenum(char *s)
+{
+	char *e;
+	uint32_t v;
+
+	v = strtoul(s, &e, 10);	/* as atoi does outside a set */
+	if(e == s || *e != 0)
+		sysfatal("bad number in set: %s", s);
+	return v;
+}
+
+/*
+ *  one number or lo..hi
+ */
+static void
+parserange(Range *r, char *s)
+{
+	char *p;
+
+	p = strstr(s, "..");
+	if(p != NULL){
+		*p = 0;
+		r->lo = parsenum(s);
+		r->hi = parsenum(p+2);
+		*p = '.';
+		if(r->lo > r->hi)
+			sysfatal("empty range in set: %s", s);
+	} else
+		r->lo = r->hi = parsenum(s);
+}
+
+static int
+rangecmp(const void *a, const void *b)
+{
+	const Range *ra = a, *rb = b;
+
+	if(ra->lo < rb->lo)
+		return -1;
+	return ra->lo > rb->lo;
+}
+
+static void
+numset(Set *s, char **elem, int nelem)
+{
+	Range *r;
+	int i, n;
+	uint32_t v;
+
+	r = malloc(nelem*sizeof(Range));
+	if(r == NULL)
+		sysfatal("parseset: %r");
+	for(i = 0; i < nelem; i++)
+		parserange(&r[i], elem[i]);
+
+	/* sort and merge overlapping or adjacent ranges */
+	qsort(r, nelem, sizeof(Range), rangecmp);
+	for(i = 1, n = 0; i < nelem; i++){
+		if(r[i].lo <= r[n].hi || r[i].lo - 1 == r[n].hi){
+			if(r[i].hi > r[n].hi)
+				r[n].hi = r[i].hi;
+		} else
+			r[++n] = r[i];
+	}
+	n++;
+
+	s->n = n;
+	s->lo = malloc(n*sizeof(uint32_t));
+	s->hi = malloc(n*sizeof(uint32_t));
+	if(s->lo == NULL || s->hi == NULL)
+		sysfatal("parseset: %r");
+	for(i = 0; i < n; i++){
+		s->lo[i] = r[i].lo;
+		s->hi[i] = r[i].hi;
+	}
+	free(r);
+
+	if(s->hi[n-1] <= 0xffff){
+		s->bits = calloc(0x10000/8, 1);
+		if(s->bits == NULL)
+			sysfatal("parseset: %r");
+		for(i = 0; i < n; i++)
+			for(v = s->lo[i]; v <= s->hi[i]; v++)
+				s->bits[v>>3] |= 1<<(v&7);
+	}
+}
+
+/* where the element being parsed came from, for errors */
+static char	*setfile;
+static int	setline;
+
+static void
+badelem(char *msg, char *s)
+{
+	if(setfile != NULL)
+		sysfatal("%s:%d: %s: %s", setfile, setline, msg, s);
+	sysfatal("%s in set: %s", msg, s);
+}
+
+static void
+parseaddr(uint8_t *x, char *s, int ftype)
+{
+	if(parseip(x, s) == -1 || (ftype == Fv4ip && !isv4(x)))
+		badelem("bad address", s);
+}
+
+static int
+parseplen(char *s, int max)
+{
+	char *e;
+	long v;
+
+	v = strtol(s, &e, 10);
+	if(e == s || *e != 0 || v < 0 || v > max)
+		badelem("bad prefix length", s);
+	return v;
+}
+
+/*
+ *  add lo..hi as the fewest v4 prefixes that cover it
+ */
+static void
+addv4range(Lpm *l, uint8_t *lo, uint8_t *hi)
+{
+	uint64_t a, b;
+	uint8_t x[4];
+	int n;
+
+	a = NetL(lo);
+	b = NetL(hi);
+	if(a > b)
+		sysfatal("empty address range in set");
+	while(a <= b){
+		for(n = 0; n < 32; n++)
+			if((a & ((2ULL<<n)-1)) != 0 || a + (2ULL<<n) - 1 > b)
+				break;
+		hnputl(x, a);
+		lpmadd(l, x, 4, 32-n);
+		a += 1ULL<<n;
+	}
+}
+
+/*
+ *  one address, address/len or, for v4, lo..hi
+ */
+static void
+addrelem(Lpm *l, char *s, int ftype)
+{
+	uint8_t x[IPaddrlen], y[IPaddrlen];
+	char *p;
+	int plen;
+
+	p = strstr(s, "..");
+	if(p != NULL){
+		if(ftype != Fv4ip)
+			sysfatal("address ranges only for ip: %s", s);
+		*p = 0;
+		parseaddr(x, s, ftype);
+		parseaddr(y, p+2, ftype);
+		*p = '.';
+		addv4range(l, x+IPaddrlen-4, y+IPaddrlen-4);
+		return;
+	}
+
+	p = strchr(s, '/');
+	if(p != NULL)
+		*p = 0;
+	parseaddr(x, s, ftype);
+	if(p != NULL)
+		*p = '/';
+	if(ftype == Fv4ip){
+		plen = p != NULL ? parseplen(p+1, 32) : 32;
+		lpmadd(l, x+IPaddrlen-4, 4, plen);
+	} else {
+		if(p == NULL)
+			plen = 128;
+		else if(isv4(x))
+			plen = 96 + parseplen(p+1, 32);
+		else
+			plen = parseplen(p+1, 128);
+		lpmadd(l, x, IPaddrlen, plen);
+	}
+}
+
+/*
+ *  make a set from a list of elements separated by commas
+ *  or white space.  the list is overwritten.  file, if not
+ *  NULL, is where the list came from.
+ */
+static Set*
+mkset(char *list, char *what, int ftype, char *file)
+{
+	Set *s;
+	char **elem, *p;
+	int *line, i, n, ln;
+
+	n = 1;
+	for(p = list; *p; p++)
+		if(strchr(", \t\r\n", *p) != NULL)
+			n++;
+	elem = malloc(n*sizeof(char*));
+	line = malloc(n*sizeof(int));
+	if(elem == NULL || line == NULL)
+		sysfatal("parseset: %r");
+	n = 0;
+	ln = 1;
+	for(p = list; *p; ){
+		if(strchr(", \t\r\n", *p) != NULL){
+			if(*p == '\n')
+				ln++;
+			*p++ = 0;
+			continue;
+		}
+		line[n] = ln;
+		elem[n++] = p;
+		while(*p && strchr(", \t\r\n", *p) == NULL)
+			p++;
+	}
+	if(n == 0)
+		sysfatal("empty set: %s", what);
+
+	s = calloc(1, sizeof *s);
+	if(s == NULL)
+		sysfatal("parseset: %r");
+	switch(ftype){
+	case Fnum:
+		numset(s, elem, n);
+		break;
+	case Fv4ip:
+	case Fv6ip:
+		s->lpm = mklpm();
+		setfile = file;
+		for(i = 0; i < n; i++){
+			setline = line[i];
+			addrelem(s->lpm, elem[i], ftype);
+		}
+		setfile = NULL;
+		break;
+	default:
+		sysfatal("sets of this field type not supported: %s", what);
+	}
+	free(elem);
+	free(line);
+	return s;
+}
+
+Set*
+parseset(char *str, int ftype)
+{
+	Set *s;
+	char *buf, *p, *q;
+
+	buf = strdup(str);
+	if(buf == NULL)
+		sysfatal("parseset: %r");
+	p = buf;
+	if(*p == '{'){
+		p++;
+		q = strchr(p, '}');
+		if(q != NULL)
+			*q = 0;
+	}
+	s = mkset(p, str, ftype, NULL);
+	free(buf);
+	return s;
+}
+
+/*
+ *  read a set from a file, one or more elements a line,
+ *  # to the end of the line is a comment
+ */
+Set*
+loadset(char *file, int ftype)
+{
+	FILE *fp;
+	Set *s;
+	char *buf, *p;
+	long n;
+
+	fp = fopen(file, "r");
+	if(fp == NULL)
+		sysfatal("can't open %s: %r", file);
+	fseek(fp, 0, SEEK_END);
+	n = ftell(fp);
+	rewind(fp);
+	buf = malloc(n+1);
+	if(buf == NULL)
+		sysfatal("loadset: %r");
+	n = fread(buf, 1, n, fp);
+	buf[n] = 0;
+	fclose(fp);
+
+	for(p = buf; (p = strchr(p, '#')) != NULL;)
+		while(*p && *p != '\n')
+			*p++ = ' ';
+	s = mkset(buf, file, ftype, file);
+	free(buf);
+	return s;
+}
+
+int
+setmatch(Set *s, uint32_t v)
+{
+	int lo, hi, mid;
+
+	if(s->lpm != NULL)
+		return lpmmatch4(s->lpm, v);
+	if(s->bits != NULL)
+		return v <= 0xffff && (s->bits[v>>3] & (1<<(v&7)));
+
+	/* last range starting at or below v */
+	lo = 0;
+	hi = s->n;
+	while(lo < hi){
+		mid = (lo+hi)/2;
+		if(s->lo[mid] <= v)
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+	return lo > 0 && v <= s->hi[lo-1];
+}
+
+/*
+ *  v6 addresses, IPaddrlen bytes
+ */
+int
+setmatch6(Set *s, uint8_t *a)
+{
+	return lpmmatch(s->lpm, a, IPaddrlen);
+}
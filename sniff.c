@@ -0,0 +1,202 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  the next protocol for a tcp, udp or il payload whose ports aren't
+ *  in the mux.  the modules the mux names look at it with their
+ *  detect functions (see Proto.detect), and the first to say it's
+ *  theirs gets it and the rest of the flow.  a module without one,
+ *  like the ones a mux names that aren't built and so are stand-ins
+ *  made by addproto, is looked for in sigs by name.  a flow that
+ *  nobody claims in Nlook packets goes to dump from then on.
+ *  verdicts are cached a slot per flow, a new flow taking over its
+ *  slot, so a flow past its first packets costs a hash and a compare.
+ *
+ *  a packet can be decoded more than once, for -H and then to print
+ *  it say, so a slot remembers the last payload it looked at, by
+ *  memogen and address, and counts it once.
+ *
+ *  a flow here is the protocol and the pair of ports, the addresses
+ *  being a layer further up than a module can see.  so flows between
+ *  different hosts on the same ports share a verdict, the first to be
+ *  decided deciding for the rest while it keeps its slot.
+ */
+#include "ip.h"
+#include "dat.h"
+#include "protos.h"
+
+enum
+{
+	Cbits=	13,
+	Ncache=	1<<Cbits,
+	Nlook=	8,
+
+	/* from fcall.h */
+	Tversion=	100,
+	Terror=	106,
+	Tmax=	128,
+	Hdr9p=	4+1+2,	/* size[4] type[1] tag[2] */
+};
+
+typedef struct Verdict Verdict;
+struct Verdict
+{
+	Proto	*up;
+	uint32_t	ports;
+	Proto	*pr;	/* NULL while still looking */
+	int	n;	/* payloads looked at */
+	uint32_t	gen;	/* memogen of the last */
+	uint8_t	*last;
+};
+
+typedef struct Sig Sig;
+struct Sig
+{
+	char	*name;
+	int	(*detect)(uint8_t*, uint8_t*);
+};
+
+static int	dnssig(uint8_t*, uint8_t*);
+static int	ninepsig(uint8_t*, uint8_t*);
+
+static Sig sigs[] =
+{
+	{"dns",		dnssig, },
+	{"ninep",	ninepsig, },
+	{0},
+};
+
+static Verdict	cache[Ncache];
+static int	cached;	/* cache[] isn't all zero */
+
+/*
+ *  a dns header with a usual opcode and one question, whose name fits
+ */
+static int
+dnsmsg(uint8_t *p, uint8_t *e)
+{
+	int op, class;
+
+	if(e - p < 12+1+4)
+		return 0;
+	op = (p[2]>>3) & 0xf;
+	if(op == 3 || op > 5 || (p[3] & 0x40) || (p[3] & 0xf) > 10)
+		return 0;
+	if(NetS(p+4) != 1 || ((p[2] & 0x80) == 0 && NetS(p+6) != 0))
+		return 0;
+	for(p += 12; p < e && *p != 0; p += *p + 1)
+		if(*p > 63)
+			return 0;
+	if(e - p < 1+4 || NetS(p+1) == 0)
+		return 0;
+	class = NetS(p+3) & 0x7fff;
+	return class == 1 || class == 3 || class == 4 || class == 255;
+}
+
+/*
+ *  a dns message, or over tcp one behind its length
+ */
+static int
+dnssig(uint8_t *p, uint8_t *e)
+{
+	if(e - p >= 2 && NetS(p) == e - p - 2 && dnsmsg(p+2, e))
+		return 1;
+	return dnsmsg(p, e);
+}
+
+/*
+ *  whole 9p messages with sizes that add up and types that are 9p's
+ */
+static int
+ninepsig(uint8_t *p, uint8_t *e)
+{
+	uint32_t n;
+
+	if(e - p < Hdr9p)
+		return 0;
+	for(; e - p >= Hdr9p; p += n){
+		n = p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24;
+		if(n < Hdr9p || n > e - p)
+			return 0;
+		if(p[4] < Tversion || p[4] >= Tmax || p[4] == Terror)
+			return 0;
+	}
+	return p == e;
+}
+
+static int
+detect(Proto *pr, uint8_t *p, uint8_t *e)
+{
+	Sig *s;
+
+	if(pr->detect != NULL)
+		return (*pr->detect)(p, e);
+	for(s = sigs; s->name != NULL; s++)
+		if(strcmp(s->name, pr->name) == 0)
+			return (*s->detect)(p, e);
+	return 0;
+}
+
+/*
+ *  forget every flow
+ */
+void
+sniffreset(void)
+{
+	if(cached)
+		memset(cache, 0, sizeof cache);
+	cached = 0;
+}
+
+Proto*
+sniff(Proto *up, int sport, int dport, uint8_t *p, uint8_t *e)
+{
+	uint32_t ports;
+	Verdict *v;
+	Mux *mx;
+
+	/* the same either way */
+	if(sport < dport)
+		ports = sport<<16 | dport;
+	else
+		ports = dport<<16 | sport;
+	v = &cache[(ports * 2654435761U) >> (32-Cbits)];
+	if(v->up != up || v->ports != ports){
+		cached = 1;
+		v->up = up;
+		v->ports = ports;
+		v->pr = NULL;
+		v->n = 0;
+		v->last = NULL;
+	}
+	if(v->pr != NULL)
+		return v->pr;
+	if(p >= e)
+		return &dump;
+	/* looked at already, and nobody took it */
+	if(v->gen == memogen && v->last == p)
+		return &dump;
+	v->gen = memogen;
+	v->last = p;
+
+	for(mx = up->mux; mx->name != NULL; mx++){
+		if(mx->pr == &dump || mx->val == ~0)
+			continue;
+		/* a module under several ports */
+		if(mx > up->mux && mx[-1].pr == mx->pr)
+			continue;
+		if(detect(mx->pr, p, e)){
+			v->pr = mx->pr;
+			return v->pr;
+		}
+	}
+	if(++v->n >= Nlook)
+		v->pr = &dump;
+	return &dump;
+}
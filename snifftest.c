@@ -0,0 +1,154 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  snifftest
+ *
+ *  checks on sniff.c: tcp payloads on ports no mux names go through
+ *  seprintpkt, and the protocol printed has to be the one the
+ *  payload is.  exits with a status if any check fails.
+ *
+ *  linked with snoopy's objects, whose main the Makefile renames.
+ */
+#include "ip.h"
+#include <stdio.h>
+#include <string.h>
+#include "dat.h"
+#include "protos.h"
+
+#undef main
+
+enum
+{
+	Ehdr=	14,
+	Iphdr=	20,
+	Tcphdr=	20,
+	Hdrs=	Ehdr+Iphdr+Tcphdr,
+	Maxpay=	256,
+	Outlen=	16*1024,
+	Many=	64,	/* more packets than sniff looks at */
+};
+
+extern Proto	*root;
+extern int	sflag;
+extern char*	seprintpkt(char*, char*, uint8_t*, uint8_t*);
+extern void	mkprotograph(void);
+extern void	installfmts(void);
+
+static char	out[Outlen];
+static int	failed;
+
+/* Tversion msize=8192 version=9P2000 */
+static uint8_t tversion[] = {
+	19, 0, 0, 0, 100, 0xff, 0xff, 0, 0x20, 0, 0, 6, 0, '9', 'P', '2', '0', '0', '0',
+};
+
+/* a query for www.example.com, behind tcp's length */
+static uint8_t dnsq[] = {
+	0, 33,
+	0x12, 0x34, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 0,
+	3, 'w', 'w', 'w', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0,
+	0, 1, 0, 1,
+};
+
+static uint8_t junk[] = "no protocol at all, just some bytes";
+
+/*
+ *  an ether/ip/tcp packet from sport to dport with pay in it
+ */
+static int
+mkpkt(uint8_t *p, int sport, int dport, uint8_t *pay, int n)
+{
+	memset(p, 0, Hdrs);
+	p[12] = 0x08;
+	p[14] = 0x45;
+	hnputs(p+16, Iphdr+Tcphdr+n);
+	p[22] = 64;
+	p[23] = 6;
+	p[26] = 10;
+	p[29] = 1;
+	p[30] = 10;
+	p[33] = 2;
+	hnputs(p+34, sport);
+	hnputs(p+36, dport);
+	p[46] = (Tcphdr/4)<<4;
+	p[47] = 0x18;
+	memmove(p+Hdrs, pay, n);
+	return Hdrs+n;
+}
+
+/*
+ *  the packet as a new one, as filtering it would make it
+ */
+static char*
+decode(uint8_t *p, int n)
+{
+	char *e;
+
+	memogen++;
+	e = seprintpkt(out, out+sizeof out-1, p, p+n);
+	*e = 0;
+	return out;
+}
+
+static void
+check(char *what, char *s, char *want)
+{
+	if(strstr(s, want) != NULL)
+		return;
+	fprintf(stderr, "snifftest: %s: no %s in:%s", what, want, s);
+	failed = 1;
+}
+
+int
+main(int argc, char **argv)
+{
+	uint8_t pkt[Hdrs+Maxpay], pkt2[Hdrs+Maxpay];
+	char *s;
+	int i, n;
+
+	installfmts();
+	mkprotograph();
+	root = &ether;
+	sflag = 1;
+
+	n = mkpkt(pkt, 40000, 7777, tversion, sizeof tversion);
+	check("9p", decode(pkt, n), "ninep(");
+
+	n = mkpkt(pkt, 40001, 5300, dnsq, sizeof dnsq);
+	check("dns", decode(pkt, n), "dns(");
+
+	n = mkpkt(pkt, 40002, 7001, junk, sizeof junk);
+	s = decode(pkt, n);
+	check("junk", s, "dump(");
+	if(strstr(s, "ninep(") != NULL || strstr(s, "dns(") != NULL){
+		fprintf(stderr, "snifftest: junk: taken for a protocol:%s", s);
+		failed = 1;
+	}
+
+	/* one packet decoded many times is one look */
+	n = mkpkt(pkt, 40003, 7002, junk, sizeof junk);
+	decode(pkt, n);
+	for(i = 0; i < Many; i++)
+		seprintpkt(out, out+sizeof out-1, pkt, pkt+n);
+	n = mkpkt(pkt2, 40003, 7002, tversion, sizeof tversion);
+	check("9p after one junk packet", decode(pkt2, n), "ninep(");
+
+	/* a flow that's junk for long enough stays dump */
+	n = mkpkt(pkt, 40004, 7003, junk, sizeof junk);
+	for(i = 0; i < Many; i++)
+		decode(pkt, n);
+	n = mkpkt(pkt2, 40004, 7003, tversion, sizeof tversion);
+	check("9p after many junk packets", decode(pkt2, n), "dump(");
+
+	if(failed)
+		exit(1);
+	printf("snifftest: ok\n");
+	return 0;
+}
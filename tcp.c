@@ -109,15 +109,45 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Os:
-		return NetS(h->sport) == f->ulv;
+		return fmatch(f, NetS(h->sport));
 	case Od:
-		return NetS(h->dport) == f->ulv;
+		return fmatch(f, NetS(h->dport));
 	case Osd:
-		return NetS(h->sport) == f->ulv || NetS(h->dport) == f->ulv;
+		return fmatch(f, NetS(h->sport)) || fmatch(f, NetS(h->dport));
 	}
 	return 0;
 }
 
+/*
+ *  header length is the top 6 bits of flag, as in p_filter
+ */
+static int
+p_lower(Filter *f, Vop *v)
+{
+	v->minlen = TCPLEN;
+	v->hoff = offsetof(Hdr, flag);
+	v->hmask = 0xfc;
+	v->hshift = 4;
+
+	switch(f->subop){
+	case Os:
+		v->off[v->noff++] = offsetof(Hdr, sport);
+		break;
+	case Od:
+		v->off[v->noff++] = offsetof(Hdr, dport);
+		break;
+	case Osd:
+		v->off[v->noff++] = offsetof(Hdr, sport);
+		v->off[v->noff++] = offsetof(Hdr, dport);
+		break;
+	default:
+		return 0;
+	}
+	v->width = 2;
+	v->val = f->ulv;
+	return 1;
+}
+
 enum
 {
 	URG		= 0x20,		/* Data marked urgent */
@@ -173,6 +203,8 @@ p_seprint(Msg *m)
 	dport = NetS(h->dport);
 	sport = NetS(h->sport);
 	demux(p_mux, sport, dport, m, &dump);
+	if(m->pr == &dump)
+		m->pr = sniff(&tcp, sport, dport, m->ps, m->pe);
 
 	m->p = seprint(m->p, m->e, "s=%d d=%d seq=%lu ack=%lu fl=%s hl=%d win=%d ck=%4.4x",
 			NetS(h->sport), dport,
@@ -226,4 +258,5 @@ Proto tcp =
 	"%lu",
 	p_fields,
 	defaultframer,
+	p_lower,
 };
@@ -0,0 +1,399 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  -T n[:secs]: the top n sources, destinations, source and
+ *  destination ports and flows of the matching ip packets, by
+ *  packets, instead of printing them.  printed every secs of packet
+ *  time, and then started over, unless secs is 0, and at the end.
+ *
+ *  the memory doesn't grow with the number of keys.  each kind of key
+ *  has a space-saving list of Nlist*n keys and a count-min sketch,
+ *  Depth rows of Width counters, that gives an estimate never under
+ *  the truth for any key.  a key in the list just has its count
+ *  bumped.  one that isn't takes the place of the list's smallest,
+ *  with the smallest's count plus one, over by at most the smallest's
+ *  count: a key out of the list hasn't been seen more often than
+ *  that.  the sketch keeps one-off keys from churning the list: a key
+ *  whose estimate isn't over the smallest's count hasn't been seen
+ *  more often than it, and stays out.  the list is a min-heap, with a
+ *  hash table to find a key in it.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "ip.h"
+#include "dat.h"
+
+int Tflag;
+int Tival;
+
+enum
+{
+	Sec=	1000000000LL,
+	Depth=	4,
+	Width=	8192,	/* a power of 2 */
+	Nlist=	8,	/* list entries per key reported */
+	Keylen=	2*IPaddrlen+5,
+
+	Ksrc=	0,
+	Kdst,
+	Ksport,
+	Kdport,
+	Kflow,
+	Nkind,
+
+	Ttcp=	6,
+	Tudp=	17,
+};
+
+typedef struct Ent Ent;
+struct Ent
+{
+	uint8_t	key[Keylen];
+	uint64_t	h;
+	uint64_t	n;
+	uint64_t	err;	/* n is at most this much over */
+	uint64_t	bytes;	/* since it came in the list */
+	int	heap;	/* its place there */
+};
+
+typedef struct Top Top;
+struct Top
+{
+	uint32_t	*cm;	/* Depth rows of Width */
+	Ent	*ent;
+	Ent	**heap;
+	int	nheap;
+	Ent	**tab;	/* linear probing, ntab is a power of 2 */
+	int	ntab;
+};
+
+static char *kindname[Nkind] = {
+[Ksrc]		"src",
+[Kdst]		"dst",
+[Ksport]	"sport",
+[Kdport]	"dport",
+[Kflow]		"flow",
+};
+
+extern Proto *root;
+
+static Top	top[Nkind];
+static int	nlist;
+static uint64_t	npkt;
+static int64_t	nextprint;
+
+static void
+topinit(void)
+{
+	uint32_t *cm;
+	Top *t;
+	int i;
+
+	nlist = Nlist*Tflag;
+	cm = bigalloc(Nkind*Depth*Width*sizeof(uint32_t));
+	for(i = 0; i < Nkind; i++){
+		t = &top[i];
+		t->cm = cm + i*Depth*Width;
+		for(t->ntab = 1; t->ntab < 2*nlist; t->ntab <<= 1)
+			;
+		t->ent = calloc(nlist, sizeof(Ent));
+		t->heap = calloc(nlist, sizeof(Ent*));
+		t->tab = calloc(t->ntab, sizeof(Ent*));
+		if(t->ent == NULL || t->heap == NULL || t->tab == NULL)
+			sysfatal("topinit: %r");
+	}
+}
+
+static void
+topreset(void)
+{
+	Top *t;
+
+	for(t = top; t < top+Nkind; t++){
+		memset(t->cm, 0, Depth*Width*sizeof(uint32_t));
+		memset(t->tab, 0, t->ntab*sizeof(Ent*));
+		t->nheap = 0;
+	}
+	npkt = 0;
+}
+
+/*
+ *  add one to the key's counters, return the least of them.
+ *  the rows' hashes are h1 + i*h2.
+ */
+static uint64_t
+cmadd(Top *t, uint64_t h)
+{
+	uint32_t h1, h2, *c, min;
+	int i;
+
+	h1 = h;
+	h2 = (h >> 32) | 1;
+	min = ~0;
+	for(i = 0; i < Depth; i++){
+		c = &t->cm[i*Width + ((h1 + i*h2) & (Width-1))];
+		if(*c != ~0U)
+			(*c)++;
+		if(*c < min)
+			min = *c;
+	}
+	return min;
+}
+
+static void
+swap(Top *t, int i, int j)
+{
+	Ent *e;
+
+	e = t->heap[i];
+	t->heap[i] = t->heap[j];
+	t->heap[j] = e;
+	t->heap[i]->heap = i;
+	t->heap[j]->heap = j;
+}
+
+/*
+ *  e's count went up, move it down
+ */
+static void
+sink(Top *t, Ent *e)
+{
+	int i, c;
+
+	i = e->heap;
+	for(;;){
+		c = 2*i+1;
+		if(c >= t->nheap)
+			break;
+		if(c+1 < t->nheap && t->heap[c+1]->n < t->heap[c]->n)
+			c++;
+		if(t->heap[c]->n >= t->heap[i]->n)
+			break;
+		swap(t, i, c);
+		i = c;
+	}
+}
+
+static Ent**
+lookup(Top *t, uint8_t *k, uint64_t h)
+{
+	Ent **e;
+	int i;
+
+	for(i = h & (t->ntab-1);; i = (i+1) & (t->ntab-1)){
+		e = &t->tab[i];
+		if(*e == NULL || ((*e)->h == h && memcmp((*e)->key, k, Keylen) == 0))
+			return e;
+	}
+}
+
+/*
+ *  take e out of the table, moving up the ones after it in its run
+ */
+static void
+unhash(Top *t, Ent *e)
+{
+	int i, j, want;
+
+	i = lookup(t, e->key, e->h) - t->tab;
+	for(j = (i+1) & (t->ntab-1); t->tab[j] != NULL; j = (j+1) & (t->ntab-1)){
+		want = t->tab[j]->h & (t->ntab-1);
+		/* can it move back to i? */
+		if(((j - want) & (t->ntab-1)) >= ((j - i) & (t->ntab-1))){
+			t->tab[i] = t->tab[j];
+			i = j;
+		}
+	}
+	t->tab[i] = NULL;
+}
+
+static void
+count(Top *t, uint8_t *k, int len)
+{
+	uint64_t h, est;
+	Ent **slot, *e;
+
+	h = hash64(k, Keylen);
+	est = cmadd(t, h);
+	slot = lookup(t, k, h);
+	e = *slot;
+	if(e != NULL){
+		e->n++;
+		e->bytes += len;
+		sink(t, e);
+		return;
+	}
+
+	if(t->nheap < nlist){
+		e = &t->ent[t->nheap];
+		e->heap = t->nheap;
+		t->heap[t->nheap++] = e;
+		e->err = 0;	/* nothing has left the list */
+	} else {
+		e = t->heap[0];
+		if(est <= e->n)
+			return;
+		unhash(t, e);
+		slot = lookup(t, k, h);
+		e->err = e->n;
+	}
+	memmove(e->key, k, Keylen);
+	e->h = h;
+	e->n = e->err + 1;
+	e->bytes = len;
+	*slot = e;
+	sink(t, e);
+}
+
+/*
+ *  count a matching packet under each of its keys
+ */
+void
+topadd(Pkt *p)
+{
+	uint8_t k[Keylen];
+	int64_t ival;
+	Flow fl;
+	int len;
+
+	if(nlist == 0)
+		topinit();
+	if(Tival > 0 && p->time >= nextprint){
+		if(nextprint != 0){
+			topprint();
+			topreset();
+		}
+		ival = (int64_t)Tival*Sec;
+		nextprint = (p->time/ival + 1) * ival;
+	}
+	if(!flowkey(&fl, p->ps, p->pe, root))
+		return;
+	npkt++;
+	len = p->pe - p->ps;
+
+	memset(k, 0, Keylen);
+	memmove(k, fl.src, IPaddrlen);
+	count(&top[Ksrc], k, len);
+	memmove(k, fl.dst, IPaddrlen);
+	count(&top[Kdst], k, len);
+	if(fl.l4 != NULL){
+		memset(k, 0, Keylen);
+		k[0] = fl.proto;
+		hnputs(k+1, fl.sport);
+		count(&top[Ksport], k, len);
+		hnputs(k+1, fl.dport);
+		count(&top[Kdport], k, len);
+	}
+	memmove(k, fl.src, IPaddrlen);
+	memmove(k+IPaddrlen, fl.dst, IPaddrlen);
+	hnputs(k+2*IPaddrlen, fl.sport);
+	hnputs(k+2*IPaddrlen+2, fl.dport);
+	k[2*IPaddrlen+4] = fl.proto;
+	count(&top[Kflow], k, len);
+}
+
+static char*
+seprintaddr(char *p, char *e, uint8_t *a)
+{
+	if(isv4(a))
+		return seprint(p, e, "%V", a+IPaddrlen-4);
+	return seprint(p, e, "%I", a);
+}
+
+static char*
+seprintport(char *p, char *e, int proto, uint8_t *port)
+{
+	switch(proto){
+	case Ttcp:
+		return seprint(p, e, "tcp!%d", nhgets(port));
+	case Tudp:
+		return seprint(p, e, "udp!%d", nhgets(port));
+	}
+	return seprint(p, e, "%d!%d", proto, nhgets(port));
+}
+
+static char*
+seprintkey(char *p, char *e, int kind, uint8_t *k)
+{
+	switch(kind){
+	case Ksrc:
+	case Kdst:
+		return seprintaddr(p, e, k);
+	case Ksport:
+	case Kdport:
+		return seprintport(p, e, k[0], k+1);
+	}
+	p = seprintaddr(p, e, k);
+	if(k[2*IPaddrlen+4] == Ttcp || k[2*IPaddrlen+4] == Tudp)
+		p = seprint(p, e, "!%d", nhgets(k+2*IPaddrlen));
+	p = seprint(p, e, " -> ");
+	p = seprintaddr(p, e, k+IPaddrlen);
+	if(k[2*IPaddrlen+4] == Ttcp || k[2*IPaddrlen+4] == Tudp)
+		p = seprint(p, e, "!%d", nhgets(k+2*IPaddrlen+2));
+	return seprint(p, e, " pr=%d", k[2*IPaddrlen+4]);
+}
+
+static int
+entcmp(const void *a, const void *b)
+{
+	Ent *x, *y;
+
+	x = *(Ent**)a;
+	y = *(Ent**)b;
+	if(x->n != y->n)
+		return x->n > y->n ? -1 : 1;
+	return 0;
+}
+
+/*
+ *  the top Tflag of each kind, in one write so workers' tables
+ *  don't interleave
+ */
+void
+topprint(void)
+{
+	char *buf, *p, *e;
+	Ent **sorted;
+	Top *t;
+	size_t n;
+	int i, k, ns;
+
+	if(npkt == 0)
+		return;
+	n = Nkind*(Tflag+2)*160;
+	buf = malloc(n);
+	sorted = malloc(nlist*sizeof(Ent*));
+	if(buf == NULL || sorted == NULL)
+		sysfatal("topprint: %r");
+	p = buf;
+	e = buf + n;
+	for(k = 0; k < Nkind; k++){
+		t = &top[k];
+		ns = t->nheap;
+		memmove(sorted, t->heap, ns*sizeof(Ent*));
+		qsort(sorted, ns, sizeof sorted[0], entcmp);
+		if(ns > Tflag)
+			ns = Tflag;
+		p = seprint(p, e, "top %d %s of %llu ip packets, pid %d\n", Tflag, kindname[k],
+			(unsigned long long)npkt, getpid());
+		p = seprint(p, e, "  %12s %7s %10s %14s %s\n", "packets", "", "max over", "bytes", kindname[k]);
+		for(i = 0; i < ns; i++){
+			p = seprint(p, e, "  %12llu %6.2f%% %10llu %14llu ",
+				(unsigned long long)sorted[i]->n, 100.0*sorted[i]->n/npkt,
+				(unsigned long long)sorted[i]->err,
+				(unsigned long long)sorted[i]->bytes);
+			p = seprintkey(p, e, k, sorted[i]->key);
+			p = seprint(p, e, "\n");
+		}
+	}
+	write(1, buf, p - buf);
+	free(sorted);
+	free(buf);
+}
@@ -55,8 +55,107 @@ static Mux p_mux[] =
 	{0},
 };
 
-/* default next protocol, can be changed by p_filter, reset by p_compile */
-static Proto	*defproto = &dump;
+/*
+ *  rtp and rtcp have no ports of their own, so they're learned.  a
+ *  port is taken to be an rtp session's once Nconfirm packets in a
+ *  row to it pass rtp's detect, from one source with sequence numbers
+ *  going up by a little, or rtcp's, from one source, and the rtp
+ *  port's odd neighbour is taken for its rtcp.  after that a
+ *  packet to or from the port with version 2 is rtcp if its type is
+ *  200 to 204 and rtp otherwise (rfc 5761).  one lookup in a table
+ *  indexed by port a packet.  seeing the same packet again, filtered
+ *  and then printed, counts once.
+ */
+enum
+{
+	Nconfirm=	4,
+	Maxgap=	100,	/* sequence numbers skipped, to still be in a row */
+
+	RTPLEN=	12,
+	Psr=	200,
+	Papp=	204,
+};
+
+typedef struct Port Port;
+struct Port
+{
+	uint32_t	ssrc;
+	uint16_t	seq;	/* or a hash of the rtcp */
+	uint8_t	n;	/* packets in a row that look right */
+	uint8_t	isrtcp;
+};
+
+static Port	port[1<<16];
+static int	learned;	/* port[] isn't all zero */
+
+/*
+ *  count a packet to a port that isn't known yet
+ */
+static void
+learn(int dport, uint8_t *p, uint8_t *e)
+{
+	uint32_t ssrc;
+	uint16_t seq, d;
+	int c, again;
+	Port *pt;
+
+	pt = &port[dport];
+	learned = 1;
+	if((c = (*rtcp.detect)(p, e)) != 0){
+		ssrc = NetL(p+4);
+		seq = hash64(p, e - p < 64 ? e - p : 64);
+	} else if((*rtp.detect)(p, e)){
+		ssrc = NetL(p+8);
+		seq = NetS(p+2);
+	} else {
+		pt->n = 0;
+		return;
+	}
+	d = seq - pt->seq;
+	again = pt->n > 0 && pt->isrtcp == c && pt->ssrc == ssrc;
+	if(again && d == 0)
+		return;
+	if(again && (c || d <= Maxgap))
+		pt->n++;
+	else
+		pt->n = 1;
+	pt->ssrc = ssrc;
+	pt->seq = seq;
+	pt->isrtcp = c;
+	if(pt->n >= Nconfirm && !c && (dport&1) == 0 && port[dport+1].n < Nconfirm)
+		port[dport+1].n = Nconfirm;
+}
+
+/*
+ *  forget what's been learned
+ */
+void
+udpreset(void)
+{
+	if(learned)
+		memset(port, 0, sizeof port);
+	learned = 0;
+}
+
+/*
+ *  rtp, rtcp or neither for a udp payload
+ */
+static Proto*
+rtpguess(int sport, int dport, uint8_t *p, uint8_t *e)
+{
+	if(port[dport].n < Nconfirm && port[sport].n < Nconfirm){
+		learn(dport, p, e);
+		if(port[dport].n < Nconfirm)
+			return NULL;
+	}
+	if(e - p < 8 || (p[0]>>6) != 2)
+		return NULL;
+	if(p[1] >= Psr && p[1] <= Papp)
+		return &rtcp;
+	if(e - p < RTPLEN)
+		return NULL;
+	return &rtp;
+}
 
 static void
 p_compile(Filter *f)
@@ -91,23 +190,49 @@ p_filter(Filter *f, Msg *m)
 
 	switch(f->subop){
 	case Os:
-		return NetS(h->sport) == f->ulv;
+		return fmatch(f, NetS(h->sport));
 	case Od:
-		return NetS(h->dport) == f->ulv;
+		return fmatch(f, NetS(h->dport));
 	case Osd:
-		if(f->ulv == ANYPORT){
-			defproto = f->pr;
-			return 1;
-		}
-		return NetS(h->sport) == f->ulv || NetS(h->dport) == f->ulv;
+		if(f->ulv == ANYPORT)
+			return rtpguess(NetS(h->sport), NetS(h->dport), m->ps, m->pe) == f->pr;
+		return fmatch(f, NetS(h->sport)) || fmatch(f, NetS(h->dport));
 	}
 	return 0;
 }
 
+static int
+p_lower(Filter *f, Vop *v)
+{
+	v->minlen = UDPLEN;
+	v->hlen = UDPLEN;
+
+	switch(f->subop){
+	case Os:
+		v->off[v->noff++] = offsetof(Hdr, sport);
+		break;
+	case Od:
+		v->off[v->noff++] = offsetof(Hdr, dport);
+		break;
+	case Osd:
+		if(f->ulv == ANYPORT)
+			return 0;	/* learned */
+		v->off[v->noff++] = offsetof(Hdr, sport);
+		v->off[v->noff++] = offsetof(Hdr, dport);
+		break;
+	default:
+		return 0;
+	}
+	v->width = 2;
+	v->val = f->ulv;
+	return 1;
+}
+
 static int
 p_seprint(Msg *m)
 {
 	Hdr *h;
+	Proto *pr;
 	int dport, sport;
 
 
@@ -119,8 +244,11 @@ p_seprint(Msg *m)
 	/* next protocol */
 	sport = NetS(h->sport);
 	dport = NetS(h->dport);
-	demux(p_mux, sport, dport, m, defproto);
-	defproto = &dump;
+	demux(p_mux, sport, dport, m, &dump);
+	if(m->pr == &dump && (pr = rtpguess(sport, dport, m->ps, m->pe)) != NULL)
+		m->pr = pr;
+	if(m->pr == &dump)
+		m->pr = sniff(&udp, sport, dport, m->ps, m->pe);
 
 	m->p = seprint(m->p, m->e, "s=%d d=%d ck=%4.4x ln=%4d",
 			NetS(h->sport), dport,
@@ -138,4 +266,5 @@ Proto udp =
 	"%lu",
 	p_fields,
 	defaultframer,
+	p_lower,
 };
@@ -0,0 +1,525 @@
+/*
+ * This file is part of the UCB release of Plan 9. It is subject to the license
+ * terms in the LICENSE file found in the top-level directory of this
+ * distribution and at http://akaros.cs.berkeley.edu/files/Plan9License. No
+ * part of the UCB release of Plan 9, including this file, may be copied,
+ * modified, propagated, or distributed except according to the terms contained
+ * in the LICENSE file.
+ */
+
+/*
+ *  -U: capture reads and output writes through a linux io_uring, so
+ *  a slow reader of our output doesn't hold up the capture.
+ *
+ *  output is copied into registered buffers, packets to the same
+ *  file coalescing, and written in the background: files we can seek
+ *  on get every full buffer in flight at its own offset, anything
+ *  else one write at a time so the order holds.  we only wait when
+ *  every buffer is full.  big packets in pool buffers aren't copied,
+ *  the write holds a reference to the buffer instead.
+ *
+ *  a live source gets Nbatch reads in flight, one packet each into a
+ *  pool buffer, taken in the order they complete.
+ */
+#ifdef __linux__
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "ip.h"
+#include "dat.h"
+
+enum
+{
+	Nentries=	128,
+	Nobuf=	64,		/* output buffers */
+	Obuflen=	64*1024,
+	Poolidx=	Nobuf,	/* registered buffer number of the pool */
+	Bigwrite=	8*1024,	/* written in place rather than copied */
+	Nofile=	256,	/* output fds we'll handle */
+};
+
+typedef struct Obuf Obuf;
+typedef struct Ofile Ofile;
+typedef struct Rd Rd;
+
+struct Obuf
+{
+	int	idx;		/* registered buffer number */
+	Pbuf	*pb;		/* pool buffer p is in, if any */
+	char	*p;
+	int	n;
+	int	done;		/* written so far */
+	int64_t	off;		/* file offset, -1 for unseekable files */
+	Ofile	*of;
+	Obuf	*next;
+};
+
+struct Ofile
+{
+	int	fd;
+	int	seekable;
+	int64_t	off;
+	int	busy;		/* writes in flight */
+	Obuf	*cur;		/* being filled */
+	Obuf	*qh;		/* waiting to be written */
+	Obuf	*qt;
+};
+
+/*
+ *  a read in flight
+ */
+struct Rd
+{
+	Pbuf	*pb;		/* nil once handed over */
+	int	n;
+};
+
+typedef struct Uring Uring;
+struct Uring
+{
+	int	fd;
+	unsigned	*sqhead;
+	unsigned	*sqtail;
+	unsigned	sqmask;
+	unsigned	*sqarray;
+	struct io_uring_sqe	*sqes;
+	unsigned	*cqhead;
+	unsigned	*cqtail;
+	unsigned	cqmask;
+	struct io_uring_cqe	*cqes;
+	unsigned	nsq;
+	int	tosubmit;
+	int	fixed;		/* buffers are registered */
+};
+
+static Uring	u;
+static Obuf	obufs[Nobuf];
+static Obuf	*ofree;
+static Obuf	*pfree;		/* for writes from pool buffers */
+static Ofile	*ofiles[Nofile];
+static Rd	rds[Nbatch];
+static int	readfd = -1;
+static int	nwriting;	/* writes in flight */
+static int	shared;		/* other processes write our files too */
+
+static int
+enter(unsigned nsubmit, unsigned nwait)
+{
+	int r;
+
+	do
+		r = syscall(__NR_io_uring_enter, u.fd, nsubmit, nwait,
+			nwait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	while(r < 0 && errno == EINTR && nwait == 0);
+	return r;
+}
+
+static void
+submit(void)
+{
+	if(u.tosubmit == 0)
+		return;
+	if(enter(u.tosubmit, 0) < 0)
+		sysfatal("io_uring_enter: %r");
+	u.tosubmit = 0;
+}
+
+static struct io_uring_sqe*
+getsqe(void)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail;
+
+	tail = *u.sqtail;
+	if(tail - __atomic_load_n(u.sqhead, __ATOMIC_ACQUIRE) == u.nsq){
+		submit();
+		return getsqe();
+	}
+	sqe = &u.sqes[tail & u.sqmask];
+	memset(sqe, 0, sizeof *sqe);
+	u.sqarray[tail & u.sqmask] = tail & u.sqmask;
+	__atomic_store_n(u.sqtail, tail+1, __ATOMIC_RELEASE);
+	u.tosubmit++;
+	return sqe;
+}
+
+/*
+ *  set up the ring.  if the output files are shared with other
+ *  processes, as with -w, offsets of our own would overwrite theirs,
+ *  so each is written a buffer at a time at its file position.
+ */
+int
+uringinit(int shr)
+{
+	struct io_uring_params p;
+	struct iovec iov[Nobuf+1];
+	uint8_t *sq, *cq, *mem;
+	size_t sqlen, cqlen, len;
+	int i;
+
+	shared = shr;
+	memset(&p, 0, sizeof p);
+	u.fd = syscall(__NR_io_uring_setup, Nentries, &p);
+	if(u.fd < 0){
+		fprintf(stderr, "no io_uring, writing directly: %s\n", strerror(errno));
+		return -1;
+	}
+	sqlen = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+	cqlen = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP){
+		if(cqlen > sqlen)
+			sqlen = cqlen;
+		cqlen = sqlen;
+	}
+	sq = mmap(NULL, sqlen, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		u.fd, IORING_OFF_SQ_RING);
+	if(sq == MAP_FAILED)
+		sysfatal("uringinit: %r");
+	if(p.features & IORING_FEAT_SINGLE_MMAP)
+		cq = sq;
+	else {
+		cq = mmap(NULL, cqlen, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+			u.fd, IORING_OFF_CQ_RING);
+		if(cq == MAP_FAILED)
+			sysfatal("uringinit: %r");
+	}
+	u.sqes = mmap(NULL, p.sq_entries*sizeof(struct io_uring_sqe),
+		PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u.fd, IORING_OFF_SQES);
+	if(u.sqes == MAP_FAILED)
+		sysfatal("uringinit: %r");
+	u.sqhead = (unsigned*)(sq + p.sq_off.head);
+	u.sqtail = (unsigned*)(sq + p.sq_off.tail);
+	u.sqmask = *(unsigned*)(sq + p.sq_off.ring_mask);
+	u.sqarray = (unsigned*)(sq + p.sq_off.array);
+	u.nsq = p.sq_entries;
+	u.cqhead = (unsigned*)(cq + p.cq_off.head);
+	u.cqtail = (unsigned*)(cq + p.cq_off.tail);
+	u.cqmask = *(unsigned*)(cq + p.cq_off.ring_mask);
+	u.cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+	mem = bigalloc(Nobuf*Obuflen);
+	for(i = 0; i < Nobuf; i++){
+		obufs[i].idx = i;
+		obufs[i].p = (char*)mem + i*Obuflen;
+		obufs[i].next = ofree;
+		ofree = &obufs[i];
+		iov[i].iov_base = obufs[i].p;
+		iov[i].iov_len = Obuflen;
+	}
+	pbpool(&mem, &len);
+	iov[Poolidx].iov_base = mem;
+	iov[Poolidx].iov_len = len;
+	/* locked memory limits can stop this, plain reads and writes still work */
+	u.fixed = syscall(__NR_io_uring_register, u.fd, IORING_REGISTER_BUFFERS,
+		iov, Nobuf+1) == 0;
+	return 0;
+}
+
+static void
+startwrite(Obuf *b)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = getsqe();
+	sqe->opcode = u.fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	sqe->fd = b->of->fd;
+	sqe->addr = (uintptr_t)(b->p + b->done);
+	sqe->len = b->n - b->done;
+	sqe->off = b->off < 0 ? (uint64_t)-1 : (uint64_t)(b->off + b->done);
+	sqe->buf_index = b->idx;
+	sqe->user_data = (uintptr_t)b;
+	b->of->busy++;
+	nwriting++;
+}
+
+/*
+ *  start what can be started of an output file's queue
+ */
+static void
+kick(Ofile *of)
+{
+	Obuf *b;
+
+	while((b = of->qh) != NULL && (of->seekable || of->busy == 0)){
+		of->qh = b->next;
+		if(of->qh == NULL)
+			of->qt = NULL;
+		startwrite(b);
+	}
+}
+
+static void	readdone(Rd*, int);
+
+/*
+ *  handle completions, waiting for at least nwait
+ */
+static void
+reap(int nwait)
+{
+	struct io_uring_cqe *cqe;
+	unsigned head;
+	Obuf *b;
+	Ofile *of;
+	int res;
+
+	submit();
+	if(nwait > 0 && __atomic_load_n(u.cqtail, __ATOMIC_ACQUIRE) == *u.cqhead)
+		if(enter(0, nwait) < 0 && errno != EINTR)
+			sysfatal("io_uring_enter: %r");
+
+	head = *u.cqhead;
+	while(head != __atomic_load_n(u.cqtail, __ATOMIC_ACQUIRE)){
+		cqe = &u.cqes[head & u.cqmask];
+		res = cqe->res;
+		if(cqe->user_data >= (uintptr_t)rds && cqe->user_data < (uintptr_t)(rds+Nbatch))
+			readdone((Rd*)(uintptr_t)cqe->user_data, res);
+		else {
+			b = (Obuf*)(uintptr_t)cqe->user_data;
+			of = b->of;
+			of->busy--;
+			nwriting--;
+			if(res < 0){
+				errno = -res;
+				sysfatal("Error writing to %d: %r", of->fd);
+			}
+			b->done += res;
+			if(b->done < b->n){
+				/* short, the rest goes next */
+				b->next = of->qh;
+				of->qh = b;
+				if(of->qt == NULL)
+					of->qt = b;
+			} else if(b->pb != NULL){
+				pbfree(b->pb);
+				b->pb = NULL;
+				b->next = pfree;
+				pfree = b;
+			} else {
+				b->next = ofree;
+				ofree = b;
+			}
+			kick(of);
+		}
+		head++;
+		__atomic_store_n(u.cqhead, head, __ATOMIC_RELEASE);
+	}
+	submit();
+}
+
+static Ofile*
+ofile(int fd)
+{
+	Ofile *of;
+
+	if(fd >= Nofile)
+		sysfatal("output fd %d too big for io_uring", fd);
+	of = ofiles[fd];
+	if(of == NULL){
+		of = calloc(1, sizeof *of);
+		if(of == NULL)
+			sysfatal("ofile: %r");
+		of->fd = fd;
+		of->off = lseek(fd, 0, SEEK_CUR);
+		of->seekable = of->off >= 0 && !shared;
+		ofiles[fd] = of;
+	}
+	return of;
+}
+
+static void
+queue(Ofile *of, Obuf *b)
+{
+	b->of = of;
+	b->done = 0;
+	b->next = NULL;
+	if(of->seekable){
+		b->off = of->off;
+		of->off += b->n;
+	} else
+		b->off = -1;
+	if(of->qt != NULL)
+		of->qt->next = b;
+	else
+		of->qh = b;
+	of->qt = b;
+}
+
+/*
+ *  write, in the background
+ */
+void
+uwrite(int fd, char *p, int n)
+{
+	Ofile *of;
+	Obuf *b;
+	int m;
+
+	of = ofile(fd);
+	while(n > 0){
+		if(of->cur == NULL){
+			while(ofree == NULL)
+				reap(1);
+			of->cur = ofree;
+			ofree = ofree->next;
+			of->cur->n = 0;
+		}
+		b = of->cur;
+		m = Obuflen - b->n;
+		if(m > n)
+			m = n;
+		memmove(b->p + b->n, p, m);
+		b->n += m;
+		p += m;
+		n -= m;
+		if(b->n == Obuflen){
+			of->cur = NULL;
+			queue(of, b);
+			kick(of);
+		}
+	}
+}
+
+/*
+ *  write bytes in pool buffer pb.  big ones are written from
+ *  there, holding a reference, instead of being copied.
+ */
+void
+uwritepkt(int fd, char *p, int n, Pbuf *pb)
+{
+	Ofile *of;
+	Obuf *b;
+
+	if(pb == NULL || n < Bigwrite){
+		uwrite(fd, p, n);
+		return;
+	}
+	of = ofile(fd);
+	if(of->cur != NULL){
+		/* what's before it goes first */
+		queue(of, of->cur);
+		of->cur = NULL;
+	}
+	b = pfree;
+	if(b != NULL)
+		pfree = b->next;
+	else if((b = calloc(1, sizeof *b)) == NULL)
+		sysfatal("uwritepkt: %r");
+	pbref(pb);
+	b->pb = pb;
+	b->idx = Poolidx;
+	b->p = p;
+	b->n = n;
+	queue(of, b);
+	kick(of);
+}
+
+/*
+ *  wait for a write to finish, if there are any
+ */
+int
+uwait(void)
+{
+	if(nwriting == 0)
+		return 0;
+	reap(1);
+	return 1;
+}
+
+/*
+ *  start writing what's buffered; with wait, until it's all written
+ */
+void
+uflush(int wait)
+{
+	Ofile *of;
+	int i;
+
+	for(i = 0; i < Nofile; i++){
+		of = ofiles[i];
+		if(of == NULL || of->cur == NULL)
+			continue;
+		queue(of, of->cur);
+		of->cur = NULL;
+		kick(of);
+	}
+	submit();
+	reap(0);
+	if(wait)
+		while(nwriting > 0)
+			reap(1);
+}
+
+static int	nready;
+static Rd	*ready[Nbatch];
+static int	nreading;
+static int	readeof;
+
+static void
+startread(Rd *r)
+{
+	struct io_uring_sqe *sqe;
+
+	r->pb = pballoc();
+	sqe = getsqe();
+	sqe->opcode = u.fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	sqe->fd = readfd;
+	sqe->addr = (uintptr_t)(r->pb->base + Headroom);
+	sqe->len = Pktlen;
+	sqe->off = (uint64_t)-1;
+	sqe->buf_index = Poolidx;
+	sqe->user_data = (uintptr_t)r;
+	nreading++;
+}
+
+static void
+readdone(Rd *r, int res)
+{
+	nreading--;
+	if(res <= 0){
+		pbfree(r->pb);
+		r->pb = NULL;
+		readeof = 1;
+		return;
+	}
+	r->n = res;
+	ready[nready++] = r;
+}
+
+/*
+ *  the next batch of packets read from fd.  their buffers are the
+ *  batch's now and new reads go in new ones.
+ */
+int
+uread(int fd, Batch *b)
+{
+	Rd *r;
+	int i;
+
+	if(readfd < 0)
+		readfd = fd;
+	for(i = 0; i < Nbatch && !readeof; i++)
+		if(rds[i].pb == NULL)
+			startread(&rds[i]);
+
+	/* after the end, reads already in flight can still bring packets */
+	while(nready == 0 && nreading > 0)
+		reap(1);
+	if(nready == 0)
+		return 0;
+
+	for(b->n = 0; b->n < nready; b->n++){
+		r = ready[b->n];
+		b->pkt[b->n].ps = r->pb->base + Headroom;
+		b->pkt[b->n].pe = b->pkt[b->n].ps + r->n;
+		b->pkt[b->n].time = epoch_nsec();
+		b->pkt[b->n].buf = r->pb;
+		r->pb = NULL;
+	}
+	nready = 0;
+	return b->n;
+}
+#endif